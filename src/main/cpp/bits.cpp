@@ -7,19 +7,88 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <cstdlib>
 #include "bits.h"
 
+__extension__ typedef unsigned __int128 uint128_t;
+
+Bits::WordStorage::WordStorage() : words(local), count(0), capacity(INLINE_WORDS) {}
+
+Bits::WordStorage::WordStorage(const WordStorage &other) : WordStorage() {
+    *this = other;
+}
+
+Bits::WordStorage::WordStorage(WordStorage &&other) noexcept : WordStorage() {
+    *this = std::move(other);
+}
+
+Bits::WordStorage::~WordStorage() {
+    if (on_heap())
+        delete[] words;
+}
+
+Bits::WordStorage &Bits::WordStorage::operator=(const WordStorage &other) {
+    if (this == &other)
+        return *this;
+
+    if (other.count > capacity)
+        reserve(other.count);
+    std::memcpy(words, other.words, other.count * sizeof(uint64_t));
+    count = other.count;
+    return *this;
+}
+
+Bits::WordStorage &Bits::WordStorage::operator=(WordStorage &&other) noexcept {
+    if (this == &other)
+        return *this;
+
+    if (!other.on_heap()) {
+        // inline values are copied, there is no buffer to steal
+        std::memcpy(words, other.words, other.count * sizeof(uint64_t));
+    } else {
+        if (on_heap())
+            delete[] words;
+        words = other.words;
+        capacity = other.capacity;
+        other.words = other.local;
+        other.capacity = INLINE_WORDS;
+    }
+
+    count = other.count;
+    other.count = 0;
+    return *this;
+}
+
+void Bits::WordStorage::resize(size_t new_count) {
+    if (new_count > capacity)
+        reserve(new_count);
+    for (size_t i = count; i < new_count; i++)
+        words[i] = 0;
+    count = new_count;
+}
+
+void Bits::WordStorage::reserve(size_t new_capacity) {
+    if (new_capacity <= capacity)
+        return;
+
+    uint64_t *new_words = new uint64_t[new_capacity];
+    std::memcpy(new_words, words, count * sizeof(uint64_t));
+    if (on_heap())
+        delete[] words;
+    words = new_words;
+    capacity = new_capacity;
+}
+
 Bits::Bits(size_t _width, bool dont_care) {
     assert(_width > 0);
 
     width = _width;
-    for (size_t i = 0; i < width; i += WORD_LEN)
-        data.push_back(0);
-
     num_words = (width + WORD_LEN - 1) / WORD_LEN;
+    data.resize(num_words);
 }
 
-size_t Bits::get_num_words() {
+size_t Bits::get_num_words() const {
     return num_words;
 }
 
@@ -33,14 +102,42 @@ Bits Bits::zeros(size_t width) {
 
 Bits Bits::random(size_t width) {
     Bits result = Bits::zeros(width);
-    for (size_t i = 0; i < result.get_num_words() - 1; i++) {
-        result.data[i] = rand();
+    // rand() gives at least 15 and usually 31 bits, combine calls until a
+    // word is covered
+    size_t rand_bits = 0;
+    for (unsigned long max = RAND_MAX; max != 0; max >>= 1)
+        rand_bits++;
+    for (size_t i = 0; i < result.get_num_words(); i++) {
+        uint64_t word = 0;
+        for (size_t filled = 0; filled < WORD_LEN; filled += rand_bits)
+            word = (word << rand_bits) ^ (uint64_t) rand();
+        result.data[i] = word;
     }
 
-    result.set_word(result.get_num_words() - 1, rand() % (((size_t) 1) << (width % WORD_LEN)));
+    result.clear_unused_bits();
+    return result;
+}
+
+Bits Bits::random(size_t width, Rng &rng) {
+    Bits result = Bits::zeros(width);
+    result.randomize(rng);
     return result;
 }
 
+void Bits::randomize(Rng &rng) {
+    rng.fill(&data[0], get_num_words());
+    clear_unused_bits();
+}
+
+void Bits::randomize(Bits *values, size_t count, Rng &rng) {
+    for (size_t i = 0; i < count; i++)
+        values[i].randomize(rng);
+}
+
+void Bits::randomize(std::vector<Bits> &values, Rng &rng) {
+    randomize(values.data(), values.size(), rng);
+}
+
 Bits::Bits() {
     width = 0;
     num_words = 0;
@@ -79,19 +176,21 @@ Bits::Bits(std::vector<uint32_t> &values) : Bits(values, false) {}
 Bits::Bits(std::vector<uint64_t> &values) : Bits(values, false) {}
 
 
-Bits Bits::operator()(size_t high, size_t low) {
+Bits Bits::operator()(size_t high, size_t low) const {
     assert(high < get_width());
-    assert(low < high);
+    assert(low <= high);
 
-    size_t result_width = high - low;
-    Bits result = *this >> low;
-    result.set_width(result_width);
+    BitsShiftRightExpr<Bits> shifted(*this, low);
+    Bits result = Bits::zeros(high - low + 1);
+    for (size_t word_idx = 0; word_idx < result.get_num_words(); word_idx++)
+        result.data[word_idx] = shifted.expr_word(word_idx);
 
+    result.clear_unused_bits();
     return result;
 }
 
 
-void Bits::operator>>=(size_t shamt) {
+Bits &Bits::operator>>=(size_t shamt) {
     size_t word_idx = 0;
 
     /* if shamt is greater than width return zero */
@@ -111,7 +210,8 @@ void Bits::operator>>=(size_t shamt) {
             size_t word_offset = shamt % WORD_LEN;
             for (; (word_idx + word_shamt) < get_num_words(); word_idx++) {
                 uint64_t word_lower = data[word_idx + word_shamt] >> word_offset;
-                uint64_t word_upper = data[word_idx + word_shamt + 1] << (WORD_LEN - word_offset);
+                uint64_t word_upper = (word_idx + word_shamt + 1) < get_num_words() ?
+                                      data[word_idx + word_shamt + 1] << (WORD_LEN - word_offset) : 0;
                 data[word_idx] = word_upper | word_lower;
             }
         }
@@ -120,179 +220,325 @@ void Bits::operator>>=(size_t shamt) {
         for (; word_idx < get_num_words(); word_idx++)
             data[word_idx] = 0;
     }
+    return *this;
 }
 
-void Bits::operator<<=(size_t shamt) {
-    size_t word_idx = 0;
-
+Bits &Bits::operator<<=(size_t shamt) {
     /* if shamt is greater than width return zero */
     if (shamt >= get_width()) {
-        for (; word_idx < get_num_words(); word_idx++)
+        for (size_t word_idx = 0; word_idx < get_num_words(); word_idx++)
             data[word_idx] = 0;
+        return *this;
+    }
 
-    } else {
-        size_t word_shamt = shamt / WORD_LEN;
+    size_t word_shamt = shamt / WORD_LEN;
+    size_t word_offset = shamt % WORD_LEN;
 
-        /* fill shift amount with zeros */
-        for (; word_idx < word_shamt; word_idx++)
-            data[word_idx] = 0;
+    /* shift bits from the top down so every source word is read before it
+       is overwritten */
+    for (size_t word_idx = get_num_words(); word_idx-- > word_shamt;) {
+        uint64_t word_upper = data[word_idx - word_shamt] << word_offset;
+        uint64_t word_lower = (word_offset != 0 && word_idx > word_shamt) ?
+                              data[word_idx - word_shamt - 1] >> (WORD_LEN - word_offset) : 0;
+        data[word_idx] = word_upper | word_lower;
+    }
 
-        /* shift bits, faster if word-aligned */
-        if (shamt % WORD_LEN == 0) {
-            for (; word_idx < get_num_words(); word_idx++)
-                data[word_idx] = (data[word_idx - word_shamt]);
+    /* fill shift amount with zeros */
+    for (size_t word_idx = 0; word_idx < word_shamt; word_idx++)
+        data[word_idx] = 0;
+
+    clear_unused_bits();
+    return *this;
+}
+
+size_t Bits::get_width() const {
+    return width;
+}
+
+void Bits::set_width(size_t new_width) {
+    assert(new_width > 0);
+
+    size_t new_num_words = (new_width + WORD_LEN - 1) / WORD_LEN;
+    data.resize(new_num_words);
+
+    if (new_width % WORD_LEN != 0) {
+        size_t extra_bits = WORD_LEN - (new_width % WORD_LEN);
+        data[new_num_words - 1] &= (~((uint64_t) 0)) >> extra_bits;
+    }
+    set_num_words(new_num_words);
+    width = new_width;
+}
+
+void Bits::clear_unused_bits() {
+    if (get_width() % WORD_LEN != 0)
+        data[get_num_words() - 1] &= (~((uint64_t) 0)) >> (WORD_LEN - get_width() % WORD_LEN);
+}
+
+uint64_t Bits::get_extended_word(size_t i, bool sign_extend) const {
+    // a width 0 value has no sign bit, it is zero and not negative
+    bool negative = sign_extend && get_width() != 0 &&
+                    ((data[(get_width() - 1) / WORD_LEN] >> ((get_width() - 1) % WORD_LEN)) & 1);
+    if (i >= get_num_words())
+        return negative ? ~((uint64_t) 0) : 0;
+
+    uint64_t word = data[i];
+    if (negative && i == get_num_words() - 1 && get_width() % WORD_LEN != 0)
+        word |= (~((uint64_t) 0)) << (get_width() % WORD_LEN);
+    return word;
+}
 
+void Bits::add_words(Bits &result, const Bits &left, const Bits &right, bool subtract) {
+    bool carry = false;
+    for (size_t word_idx = 0; word_idx < result.get_num_words(); word_idx++) {
+        uint64_t left_word = left.get_extended_word(word_idx, false);
+        uint64_t right_word = right.get_extended_word(word_idx, false);
+        uint64_t word;
+        bool carry_out;
+        if (subtract) {
+            carry_out = __builtin_sub_overflow(left_word, right_word, &word);
+            carry_out |= __builtin_sub_overflow(word, (uint64_t) carry, &word);
         } else {
-            size_t word_offset = shamt % WORD_LEN;
-            for (; word_idx < get_num_words(); word_idx++) {
-                uint64_t word_lower = data[word_idx - word_shamt] >> (WORD_LEN - word_offset);
-                uint64_t word_upper = data[word_idx - word_shamt + 1] << word_offset;
-                data[word_idx] = word_upper | word_lower;
-            }
+            carry_out = __builtin_add_overflow(left_word, right_word, &word);
+            carry_out |= __builtin_add_overflow(word, (uint64_t) carry, &word);
         }
+        result.data[word_idx] = word;
+        carry = carry_out;
     }
+
+    result.clear_unused_bits();
 }
 
-Bits Bits::operator>>(size_t shamt) {
-    Bits result(get_width());
-    result.data = data;
-    result >>= shamt;
-    return result;
+Bits operator&(const Bits &left, const Bits &right) {
+    return Bits(BitsBinaryExpr<BitsAndOp, Bits, Bits>(left, right));
 }
 
-Bits Bits::operator<<(size_t shamt) {
-    Bits result(*this);
-    result <<= shamt;
-    return result;
+Bits operator&(Bits &&left, const Bits &right) {
+    if (left.get_width() < right.get_width())
+        return static_cast<const Bits &>(left) & right;
+    left &= right;
+    return std::move(left);
 }
 
-Bits Bits::operator^(Bits &operand) {
-    size_t max_width = get_width() > operand.get_width() ? get_num_words() :
-                       operand.get_num_words();
-    Bits result(*this);
-    result.set_width(max_width);
-    result ^= operand;
-    return result;
+Bits operator|(const Bits &left, const Bits &right) {
+    return Bits(BitsBinaryExpr<BitsOrOp, Bits, Bits>(left, right));
 }
 
-void Bits::operator^=(Bits &operand) {
-    size_t word_idx = 0;
-    size_t min_words = get_width() > operand.get_width() ? operand.get_num_words() :
-                       get_num_words();
+Bits operator|(Bits &&left, const Bits &right) {
+    if (left.get_width() < right.get_width())
+        return static_cast<const Bits &>(left) | right;
+    left |= right;
+    return std::move(left);
+}
 
-    for (; word_idx < min_words; word_idx++)
-        data[word_idx] = data[word_idx] ^ operand.data[word_idx];
+Bits operator^(const Bits &left, const Bits &right) {
+    return Bits(BitsBinaryExpr<BitsXorOp, Bits, Bits>(left, right));
+}
 
-    for (; word_idx < get_num_words(); word_idx++)
-        data[word_idx] = 0;
+Bits operator^(Bits &&left, const Bits &right) {
+    if (left.get_width() < right.get_width())
+        return static_cast<const Bits &>(left) ^ right;
+    left ^= right;
+    return std::move(left);
 }
 
-void Bits::operator|=(Bits &operand) {
-    size_t word_idx = 0;
-    size_t min_words = get_width() > operand.get_width() ? operand.get_num_words() :
-                       get_num_words();
+Bits operator~(const Bits &operand) {
+    return Bits(BitsNotExpr<Bits>(operand));
+}
 
-    for (; word_idx < min_words; word_idx++)
-        data[word_idx] = data[word_idx] | operand.data[word_idx];
+Bits operator<<(const Bits &operand, size_t shamt) {
+    return Bits(BitsShiftLeftExpr<Bits>(operand, shamt));
+}
 
-    for (; word_idx < get_num_words(); word_idx++)
-        data[word_idx] = 0;
+Bits operator<<(Bits &&operand, size_t shamt) {
+    operand <<= shamt;
+    return std::move(operand);
 }
 
-Bits Bits::operator|(Bits &operand) {
-    size_t max_width = get_width() > operand.get_width() ? get_num_words() :
-                       operand.get_num_words();
-    Bits result(*this);
-    result.set_width(max_width);
-    result |= operand;
+Bits operator>>(const Bits &operand, size_t shamt) {
+    return Bits(BitsShiftRightExpr<Bits>(operand, shamt));
+}
+
+Bits operator>>(Bits &&operand, size_t shamt) {
+    operand >>= shamt;
+    return std::move(operand);
+}
+
+Bits operator+(const Bits &left, const Bits &right) {
+    Bits result = Bits::zeros(left.get_width() > right.get_width() ? left.get_width() : right.get_width());
+    Bits::add_words(result, left, right, false);
     return result;
 }
 
-Bits Bits::operator&(Bits &operand) {
-    size_t max_width = get_width() > operand.get_width() ? get_num_words() :
-                       operand.get_num_words();
-    Bits result(*this);
-    result.set_width(max_width);
-    result &= operand;
+Bits operator+(Bits &&left, const Bits &right) {
+    if (left.get_width() < right.get_width())
+        return static_cast<const Bits &>(left) + right;
+
+    // word i of left is read before it is written, the sum can reuse it
+    Bits::add_words(left, left, right, false);
+    return std::move(left);
+}
+
+Bits operator-(const Bits &left, const Bits &right) {
+    Bits result = Bits::zeros(left.get_width() > right.get_width() ? left.get_width() : right.get_width());
+    Bits::add_words(result, left, right, true);
     return result;
 }
 
-void Bits::operator&=(Bits &operand) {
-    size_t word_idx = 0;
-    size_t min_words = get_width() > operand.get_width() ? operand.get_num_words() :
-                       get_num_words();
+Bits operator-(Bits &&left, const Bits &right) {
+    if (left.get_width() < right.get_width())
+        return static_cast<const Bits &>(left) - right;
 
-    for (; word_idx < min_words; word_idx++)
-        data[word_idx] = data[word_idx] & operand.data[word_idx];
+    Bits::add_words(left, left, right, true);
+    return std::move(left);
+}
 
-    for (; word_idx < get_num_words(); word_idx++)
-        data[word_idx] = 0;
+Bits operator*(const Bits &left, const Bits &right) {
+    Bits result = Bits::zeros(left.get_width() + right.get_width());
+    size_t result_words = result.get_num_words();
+
+    // schoolbook multiplication, row i adds left word i times right
+    for (size_t i = 0; i < left.get_num_words(); i++) {
+        uint64_t carry = 0;
+        size_t j = 0;
+        for (; j < right.get_num_words() && i + j < result_words; j++) {
+            uint128_t product = (uint128_t) left.data[i] * right.data[j] + result.data[i + j] + carry;
+            result.data[i + j] = (uint64_t) product;
+            carry = (uint64_t) (product >> Bits::WORD_LEN);
+        }
+        if (i + j < result_words)
+            result.data[i + j] = carry;
+    }
+
+    result.clear_unused_bits();
+    return result;
 }
 
-Bits Bits::operator~() {
-    Bits result(*this);
-    for (size_t i = 0; i < get_num_words(); i ++) {
-        result.data[i] = ~result.data[i];
+int Bits::compare(const Bits &operand, bool is_signed) const {
+    if (is_signed) {
+        bool negative = get_extended_word(get_num_words(), true) != 0;
+        bool operand_negative = operand.get_extended_word(operand.get_num_words(), true) != 0;
+        if (negative != operand_negative)
+            return negative ? -1 : 1;
     }
 
-    size_t extra_bits = WORD_LEN - (get_width() % WORD_LEN);
-    result.data[get_num_words() - 1] &= (~((size_t) 0)) >> extra_bits;
+    // with equal signs the sign extended words compare like unsigned ones
+    size_t num_words = get_num_words() > operand.get_num_words() ? get_num_words() : operand.get_num_words();
+    for (size_t word_idx = num_words; word_idx-- > 0;) {
+        uint64_t word = get_extended_word(word_idx, is_signed);
+        uint64_t operand_word = operand.get_extended_word(word_idx, is_signed);
+        if (word != operand_word)
+            return word < operand_word ? -1 : 1;
+    }
+    return 0;
+}
+
+bool operator<(const Bits &left, const Bits &right) { return left.compare(right, false) < 0; }
+
+bool operator<=(const Bits &left, const Bits &right) { return left.compare(right, false) <= 0; }
+
+bool operator>(const Bits &left, const Bits &right) { return left.compare(right, false) > 0; }
+
+bool operator>=(const Bits &left, const Bits &right) { return left.compare(right, false) >= 0; }
+
+bool Bits::slt(const Bits &operand) const { return compare(operand, true) < 0; }
+
+bool Bits::sle(const Bits &operand) const { return compare(operand, true) <= 0; }
+
+bool Bits::sgt(const Bits &operand) const { return compare(operand, true) > 0; }
+
+bool Bits::sge(const Bits &operand) const { return compare(operand, true) >= 0; }
+
+Bits Bits::sext(size_t new_width) const {
+    Bits result = Bits::zeros(new_width);
+    for (size_t word_idx = 0; word_idx < result.get_num_words(); word_idx++)
+        result.data[word_idx] = get_extended_word(word_idx, true);
+
+    result.clear_unused_bits();
     return result;
 }
 
-size_t Bits::get_width() {
-    return width;
+Bits Bits::zext(size_t new_width) const & {
+    Bits result(*this);
+    result.set_width(new_width);
+    return result;
 }
 
-void Bits::set_width(size_t new_width) {
-    assert(new_width > 0);
+Bits Bits::zext(size_t new_width) && {
+    set_width(new_width);
+    return std::move(*this);
+}
 
-    size_t old_num_words = get_num_words();
-    size_t new_num_words = (get_width() + WORD_LEN - 1) / WORD_LEN;
-    if (new_num_words > old_num_words) {
-        for (size_t i = old_num_words; i < new_num_words; i++)
-            data.push_back(0);
-    } else {
-        for (size_t i = new_num_words; i < old_num_words; i++)
-            data.pop_back();
+size_t Bits::popcount() const {
+    size_t count = 0;
+    for (size_t word_idx = 0; word_idx < get_num_words(); word_idx++)
+        count += __builtin_popcountll(data[word_idx]);
+    return count;
+}
+
+size_t Bits::clz() const {
+    // bits of the top word above width are always zero
+    size_t unused_bits = get_num_words() * WORD_LEN - get_width();
+    for (size_t word_idx = get_num_words(); word_idx-- > 0;) {
+        if (data[word_idx] != 0)
+            return (get_num_words() - 1 - word_idx) * WORD_LEN + __builtin_clzll(data[word_idx]) - unused_bits;
     }
+    return get_width();
+}
 
-    size_t extra_bits = WORD_LEN - (new_width % WORD_LEN);
-    data[new_num_words - 1] &= (~((size_t) 0)) >> extra_bits;
-    set_num_words(new_num_words);
+size_t Bits::ctz() const {
+    for (size_t word_idx = 0; word_idx < get_num_words(); word_idx++) {
+        if (data[word_idx] != 0)
+            return word_idx * WORD_LEN + __builtin_ctzll(data[word_idx]);
+    }
+    return get_width();
 }
 
-bool Bits::operator==(Bits &operand) {
+bool Bits::reduce_and() const {
+    return popcount() == get_width();
+}
 
-    if (get_width() != operand.get_width()) {
-        return false;
+bool Bits::reduce_or() const {
+    for (size_t word_idx = 0; word_idx < get_num_words(); word_idx++) {
+        if (data[word_idx] != 0)
+            return true;
     }
+    return false;
+}
 
-    size_t word_idx = 0;
-    for (; word_idx < get_num_words(); word_idx++) {
-        if (data[word_idx] != operand.data[word_idx]) {
-            return false;
-        }
-    }
+bool Bits::reduce_xor() const {
+    uint64_t folded = 0;
+    for (size_t word_idx = 0; word_idx < get_num_words(); word_idx++)
+        folded ^= data[word_idx];
+    return __builtin_parityll(folded);
+}
+
+void Bits::insert(size_t lo, const Bits &value) {
+    assert(lo + value.get_width() <= get_width());
 
-    return true;
+    for (size_t word_idx = 0; word_idx < value.get_num_words(); word_idx++) {
+        size_t done = word_idx * WORD_LEN;
+        size_t len = value.get_width() - done < WORD_LEN ? value.get_width() - done : WORD_LEN;
+        bits_insert_words(&data[0], lo + done, len, value.data[word_idx]);
+    }
 }
 
 void Bits::set_word(size_t i, uint64_t word) {
     data[i] = word;
 }
 
-uint64_t Bits::get_word(int i) {
+uint64_t Bits::get_word(size_t i) const {
     return data[i];
 }
 
-std::ostream &Bits::print(std::ostream &o) {
+std::ostream &Bits::print(std::ostream &o) const {
     std::ios state(NULL);
     state.copyfmt(o);
     o << "0x";
-    for (size_t i = get_num_words() - 1; i >= 1; i--)
+    // a width 0 value prints as 0x0
+    size_t num_words = get_num_words();
+    for (size_t i = num_words; i-- > 1;)
         o << std::hex << data[i] << " ";
-    o << std::hex << data[0];
+    o << std::hex << (num_words > 0 ? data[0] : 0);
 
     o.copyfmt(state);
     return o;
@@ -329,7 +575,8 @@ template<class Value>
 void Bits::prepend_word(Value value) {
     uint64_t word = (uint64_t) value;
     size_t value_width = sizeof(Value) * 8;
-    (*this) << value_width;
+    set_width(get_width() + value_width);
+    *this <<= value_width;
 
     data[0] |= word;
 }
@@ -342,6 +589,6 @@ void Bits::prepend(uint16_t value) { prepend_word(value); }
 
 void Bits::prepend(uint8_t value) { prepend_word(value); }
 
-std::ostream &operator<<(std::ostream &o, Bits bits) {
+std::ostream &operator<<(std::ostream &o, const Bits &bits) {
     return bits.print(o);
 }
@@ -9,14 +9,185 @@
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <utility>
+#include "rng.h"
+
+class Bits;
+
+// contiguous run of words, e.g. the words of a Bits or of a verilator WData
+// port that cover a field
+template<class Word>
+class WordSpan {
+public:
+    WordSpan(Word *_words, size_t _count) : words(_words), count(_count) {}
+
+    Word *begin() const { return words; }
+
+    Word *end() const { return words + count; }
+
+    size_t size() const { return count; }
+
+    Word &operator[](size_t i) const { return words[i]; }
+
+private:
+    Word *words;
+    size_t count;
+};
+
+// returns the len bits, at most 64, starting at bit lo of a little endian
+// array of words. Only reads the words the field covers
+template<class Word>
+inline uint64_t bits_extract_words(const Word *words, size_t lo, size_t len) {
+    const size_t word_len = sizeof(Word) * 8;
+    assert(len > 0 && len <= 64);
+
+    size_t word_idx = lo / word_len;
+    size_t offset = lo % word_len;
+    uint64_t value = (uint64_t) words[word_idx] >> offset;
+    for (size_t done = word_len - offset; done < len; done += word_len)
+        value |= (uint64_t) words[++word_idx] << done;
+    return len == 64 ? value : value & ((((uint64_t) 1) << len) - 1);
+}
+
+// replaces the len bits, at most 64, starting at bit lo of a little endian
+// array of words with the low bits of value. Only reads and writes the words
+// the field covers
+template<class Word>
+inline void bits_insert_words(Word *words, size_t lo, size_t len, uint64_t value) {
+    const size_t word_len = sizeof(Word) * 8;
+    assert(len > 0 && len <= 64);
+
+    uint64_t mask = len == 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << len) - 1;
+    value &= mask;
+    size_t word_idx = lo / word_len;
+    size_t offset = lo % word_len;
+    Word word_mask = (Word) (mask << offset);
+    words[word_idx] = (Word) ((words[word_idx] & ~word_mask) | ((Word) (value << offset) & word_mask));
+    for (size_t done = word_len - offset; done < len; done += word_len) {
+        word_idx++;
+        word_mask = (Word) (mask >> done);
+        words[word_idx] = (Word) ((words[word_idx] & ~word_mask) | (Word) (value >> done));
+    }
+}
+
+// one field of a packed value
+struct BitsField {
+    // path of the field, see VerilatorBundle::resolve
+    const char *name;
+    // position of the lowest bit
+    size_t lo;
+    size_t width;
+};
+
+// the fields of a packed value of width bits, the generated testbench has
+// one for every bundle laid out like Chisel's asUInt
+class BitsLayout {
+public:
+    BitsLayout(const BitsField *_fields, size_t _num_fields, size_t _width)
+            : fields(_fields), num_fields(_num_fields), width(_width) {}
+
+    const BitsField *begin() const { return fields; }
+
+    const BitsField *end() const { return fields + num_fields; }
+
+    size_t size() const { return num_fields; }
+
+    const BitsField &operator[](size_t i) const { return fields[i]; }
+
+    size_t get_width() const { return width; }
+
+    // returns the field called name, NULL if there is none. Look fields up
+    // once and keep the result, this compares names
+    const BitsField *find(const std::string &name) const {
+        for (size_t i = 0; i < num_fields; i++) {
+            if (name == fields[i].name)
+                return &fields[i];
+        }
+        return NULL;
+    }
 
-class Bits {
+private:
+    const BitsField *fields;
+    size_t num_fields;
+    size_t width;
+};
+
+// base of Bits and of the expressions the bitwise and shift operators and
+// the compound operators evaluate. An expression is evaluated one word at a
+// time into the Bits it is assigned to, without an intermediate Bits per
+// operator. It refers to the Bits it was built from, so it is only used
+// inside bits.h and bits.cpp and never returned to callers.
+template<class E>
+class BitsExpr {
+public:
+    const E &self() const { return static_cast<const E &>(*this); }
+
+    size_t expr_width() const { return self().expr_width(); }
+
+    // word i of the value, zero for words above the width
+    uint64_t expr_word(size_t i) const { return self().expr_word(i); }
+
+    // true if evaluating the expression reads bits
+    bool expr_reads(const Bits *bits) const { return self().expr_reads(bits); }
+};
+
+class Bits : public BitsExpr<Bits> {
 private:
     static const size_t WORD_LEN = 64;
 
+    // number of words kept inside the Bits instance itself, only values wider
+    // than INLINE_WORDS * WORD_LEN bits allocate
+    static const size_t INLINE_WORDS = 2;
+
+    // word container with a small inline buffer, exposes the subset of the
+    // std::vector interface used by Bits
+    class WordStorage {
+    public:
+        WordStorage();
+
+        WordStorage(const WordStorage &other);
+
+        WordStorage(WordStorage &&other) noexcept;
+
+        ~WordStorage();
+
+        WordStorage &operator=(const WordStorage &other);
+
+        WordStorage &operator=(WordStorage &&other) noexcept;
+
+        uint64_t &operator[](size_t i) { return words[i]; }
+
+        const uint64_t &operator[](size_t i) const { return words[i]; }
+
+        size_t size() const { return count; }
+
+        void push_back(uint64_t word) {
+            if (count == capacity)
+                reserve(capacity * 2);
+            words[count++] = word;
+        }
+
+        void pop_back() { count--; }
+
+        // grows or shrinks to new_count words, new words are zero
+        void resize(size_t new_count);
+
+    private:
+        // points at either local or a heap buffer of capacity words
+        uint64_t *words;
+        size_t count;
+        size_t capacity;
+        uint64_t local[INLINE_WORDS];
+
+        bool on_heap() const { return words != local; }
+
+        void reserve(size_t new_capacity);
+    };
+
     size_t width;
     size_t num_words;
-    std::vector<uint64_t> data;
+    WordStorage data;
 
     // for constructing Bits of all zero dont_care parameter is to prevent
     // conflicts with other constructors
@@ -45,14 +216,53 @@ private:
     template <class Value>
     void prepend_word(Value value);
 
-    inline size_t get_num_words();
+    inline size_t get_num_words() const;
 
     inline void set_num_words(size_t _num_words);
 
+    // clears the bits of the top word above width
+    void clear_unused_bits();
+
+    // word i of this value zero or sign extended to any number of words, a
+    // width 0 value extends to zero
+    uint64_t get_extended_word(size_t i, bool sign_extend) const;
+
+    // returns a negative number, zero or a positive number if this value is
+    // less than, equal to or greater than operand, after zero or sign
+    // extending both to the same width
+    int compare(const Bits &operand, bool is_signed) const;
+
+    // sets the words of result, which may be left itself, to the sum or the
+    // difference of left and right
+    static void add_words(Bits &result, const Bits &left, const Bits &right, bool subtract);
+
+    // replaces the value with expr, which must not read this instance
+    template<class E>
+    void assign_expr(const BitsExpr<E> &expr);
+
+    // applies op to every word and the same word of operand, keeping the
+    // width of this instance
+    template<class Op, class E>
+    Bits &apply_expr(const BitsExpr<E> &operand);
+
 public:
     static Bits zeros(size_t width);
+    // uniformly random value of width bits from rand(), seeded by srand
     static Bits random(size_t width);
 
+    // uniformly random value of width bits from rng, reproducible from the
+    // seed of rng and safe to use on several threads with one rng each
+    static Bits random(size_t width, Rng &rng);
+
+    // replaces the value with a random one of the same width without
+    // allocating
+    void randomize(Rng &rng);
+
+    // randomizes every element of values, keeping their widths
+    static void randomize(Bits *values, size_t count, Rng &rng);
+
+    static void randomize(std::vector<Bits> &values, Rng &rng);
+
     Bits();
 
     // constructs a 64 wide Bits with value
@@ -83,35 +293,133 @@ public:
     // i.e. *this((i * 8) -1, i * 8) = values[i] etc.
     Bits(std::vector<uint8_t> &values);
 
+    // evaluates expr
+    template<class E>
+    Bits(const BitsExpr<E> &expr) : width(0), num_words(0) {
+        assign_expr(expr);
+    }
+
+    // evaluates expr into the words this instance already has, only
+    // allocating if expr is wider
+    template<class E>
+    Bits &operator=(const BitsExpr<E> &expr) {
+        if (expr.expr_reads(this)) {
+            Bits result(expr);
+            *this = std::move(result);
+        } else {
+            assign_expr(expr);
+        }
+        return *this;
+    }
+
+    size_t expr_width() const { return width; }
+
+    uint64_t expr_word(size_t i) const { return i < num_words ? data[i] : 0; }
+
+    bool expr_reads(const Bits *bits) const { return bits == this; }
+
     // returns a new Bits instance containing bits from position high to
-    // position low inclusive
-    Bits operator()(size_t high, size_t low);
+    // position low inclusive, so its width is high - low + 1 and a(i, i) is
+    // bit i. Only the words of the result are computed
+    Bits operator()(size_t high, size_t low) const;
+
+    Bits &operator>>=(size_t shamt);
+
+    Bits &operator<<=(size_t shamt);
+
+    // the compound bitwise operators keep the width of this instance, the
+    // operand is zero extended or truncated to it
+    template<class E>
+    Bits &operator^=(const BitsExpr<E> &operand);
+
+    template<class E>
+    Bits &operator|=(const BitsExpr<E> &operand);
+
+    template<class E>
+    Bits &operator&=(const BitsExpr<E> &operand);
+
+    // bitwise operators with the width of the wider operand, the narrower
+    // one is zero extended. An rvalue left operand at least as wide as right
+    // is updated in place, so a chain like (a & m) | c allocates once
+    friend Bits operator&(const Bits &left, const Bits &right);
 
-    Bits operator>>(size_t shamt);
+    friend Bits operator&(Bits &&left, const Bits &right);
 
-    void operator>>=(size_t shamt);
+    friend Bits operator|(const Bits &left, const Bits &right);
 
-    Bits operator<<(size_t shamt);
+    friend Bits operator|(Bits &&left, const Bits &right);
 
-    void operator<<=(size_t shamt);
+    friend Bits operator^(const Bits &left, const Bits &right);
 
-    Bits operator^(Bits &operand);
+    friend Bits operator^(Bits &&left, const Bits &right);
 
-    void operator^=(Bits &operand);
+    friend Bits operator~(const Bits &operand);
 
-    Bits operator|(Bits &operand);
+    // the shifts keep the width of their operand, an rvalue operand is
+    // shifted in place
+    friend Bits operator<<(const Bits &operand, size_t shamt);
 
-    void operator|=(Bits &operand);
+    friend Bits operator<<(Bits &&operand, size_t shamt);
 
-    Bits operator&(Bits &operand);
+    friend Bits operator>>(const Bits &operand, size_t shamt);
 
-    void operator&=(Bits &operand);
+    friend Bits operator>>(Bits &&operand, size_t shamt);
 
-    Bits operator~();
+    // sum and difference with the width of the wider operand, both operands
+    // are zero extended and the result wraps around. An rvalue left operand
+    // at least as wide as right is updated in place
+    friend Bits operator+(const Bits &left, const Bits &right);
 
-    // both bits must have the same width, will not sign or zero extend
-    // before checking
-    bool operator==(Bits &operand);
+    friend Bits operator+(Bits &&left, const Bits &right);
+
+    friend Bits operator-(const Bits &left, const Bits &right);
+
+    friend Bits operator-(Bits &&left, const Bits &right);
+
+    // full product, its width is the sum of the operand widths
+    friend Bits operator*(const Bits &left, const Bits &right);
+
+    // unsigned comparisons, operands of different widths are zero extended
+    friend bool operator<(const Bits &left, const Bits &right);
+
+    friend bool operator<=(const Bits &left, const Bits &right);
+
+    friend bool operator>(const Bits &left, const Bits &right);
+
+    friend bool operator>=(const Bits &left, const Bits &right);
+
+    // signed comparisons, each operand is sign extended from its own width
+    bool slt(const Bits &operand) const;
+
+    bool sle(const Bits &operand) const;
+
+    bool sgt(const Bits &operand) const;
+
+    bool sge(const Bits &operand) const;
+
+    // returns a copy sign or zero extended to new_width, or truncated if
+    // new_width is shorter
+    Bits sext(size_t new_width) const;
+
+    Bits zext(size_t new_width) const &;
+
+    Bits zext(size_t new_width) &&;
+
+    // number of set bits
+    size_t popcount() const;
+
+    // number of zero bits above the highest set bit, width if all are zero
+    size_t clz() const;
+
+    // number of zero bits below the lowest set bit, width if all are zero
+    size_t ctz() const;
+
+    // and, or and xor of all bits
+    bool reduce_and() const;
+
+    bool reduce_or() const;
+
+    bool reduce_xor() const;
 
     // appends 64 bits to the end of this instance with value
     void append(uint64_t value);
@@ -137,7 +445,7 @@ public:
     // left shifts by 8 bits and fills the zeros with value
     void prepend(uint8_t value);
 
-    size_t get_width();
+    size_t get_width() const;
 
     // truncates the higher order bits if new_width is shorter, otherwise
     // zero extends
@@ -145,12 +453,239 @@ public:
 
     void set_word(size_t i, uint64_t word);
 
-    uint64_t get_word(int i);
+    uint64_t get_word(size_t i) const;
+
+    // returns the len bits starting at bit lo as a T, len must be at most 64
+    // and fit in T. Only the one or two words the field covers are read
+    template<class T = uint64_t>
+    T extract(size_t lo, size_t len) const {
+        assert(len <= sizeof(T) * 8 && lo + len <= width);
+        return (T) bits_extract_words(&data[0], lo, len);
+    }
+
+    template<class T = uint64_t>
+    T extract(const BitsField &field) const {
+        return extract<T>(field.lo, field.width);
+    }
+
+    // replaces the len bits starting at bit lo with the low bits of value,
+    // len must be at most 64. Only the one or two words the field covers are
+    // written
+    void insert(size_t lo, size_t len, uint64_t value) {
+        assert(lo + len <= width);
+        bits_insert_words(&data[0], lo, len, value);
+    }
+
+    void insert(const BitsField &field, uint64_t value) {
+        insert(field.lo, field.width, value);
+    }
+
+    // replaces the value.get_width() bits starting at bit lo with value, for
+    // fields of any width
+    void insert(size_t lo, const Bits &value);
+
+    // the words of this instance, bits above the width must stay zero
+    WordSpan<uint64_t> words() { return WordSpan<uint64_t>(&data[0], num_words); }
+
+    WordSpan<const uint64_t> words() const { return WordSpan<const uint64_t>(&data[0], num_words); }
+
+    // the words covering the len bits starting at bit lo, which must be a
+    // multiple of 64
+    WordSpan<uint64_t> words(size_t lo, size_t len) {
+        assert(lo % WORD_LEN == 0 && len > 0 && lo + len <= width);
+        return WordSpan<uint64_t>(&data[lo / WORD_LEN], (len + WORD_LEN - 1) / WORD_LEN);
+    }
+
+    WordSpan<const uint64_t> words(size_t lo, size_t len) const {
+        assert(lo % WORD_LEN == 0 && len > 0 && lo + len <= width);
+        return WordSpan<const uint64_t>(&data[lo / WORD_LEN], (len + WORD_LEN - 1) / WORD_LEN);
+    }
 
     // inputs the hexadecimal representation of this instance to o
-    virtual std::ostream &print(std::ostream &o);
+    virtual std::ostream &print(std::ostream &o) const;
+};
+
+std::ostream &operator<<(std::ostream &o, const Bits &bits);
+
+// expressions keep Bits operands by reference and other expressions, which
+// are small, by value
+template<class E>
+struct BitsExprOperand {
+    typedef const E type;
+};
+
+template<>
+struct BitsExprOperand<Bits> {
+    typedef const Bits &type;
+};
+
+struct BitsAndOp {
+    static uint64_t apply(uint64_t left, uint64_t right) { return left & right; }
+};
+
+struct BitsOrOp {
+    static uint64_t apply(uint64_t left, uint64_t right) { return left | right; }
+};
+
+struct BitsXorOp {
+    static uint64_t apply(uint64_t left, uint64_t right) { return left ^ right; }
+};
+
+// left op right with the width of the wider operand, the narrower one is
+// zero extended
+template<class Op, class L, class R>
+class BitsBinaryExpr : public BitsExpr<BitsBinaryExpr<Op, L, R> > {
+public:
+    BitsBinaryExpr(const L &_left, const R &_right) : left(_left), right(_right) {}
+
+    size_t expr_width() const {
+        return left.expr_width() > right.expr_width() ? left.expr_width() : right.expr_width();
+    }
+
+    uint64_t expr_word(size_t i) const { return Op::apply(left.expr_word(i), right.expr_word(i)); }
+
+    bool expr_reads(const Bits *bits) const { return left.expr_reads(bits) || right.expr_reads(bits); }
+
+private:
+    typename BitsExprOperand<L>::type left;
+    typename BitsExprOperand<R>::type right;
+};
+
+template<class E>
+class BitsNotExpr : public BitsExpr<BitsNotExpr<E> > {
+public:
+    explicit BitsNotExpr(const E &_operand) : operand(_operand), width(_operand.expr_width()) {}
+
+    size_t expr_width() const { return width; }
+
+    uint64_t expr_word(size_t i) const {
+        if (i >= (width + 63) / 64)
+            return 0;
+        uint64_t word = ~operand.expr_word(i);
+        if (i == (width - 1) / 64 && width % 64 != 0)
+            word &= (~((uint64_t) 0)) >> (64 - width % 64);
+        return word;
+    }
+
+    bool expr_reads(const Bits *bits) const { return operand.expr_reads(bits); }
+
+private:
+    typename BitsExprOperand<E>::type operand;
+    size_t width;
+};
+
+// shifts keep the width of their operand
+template<class E>
+class BitsShiftLeftExpr : public BitsExpr<BitsShiftLeftExpr<E> > {
+public:
+    BitsShiftLeftExpr(const E &_operand, size_t _shamt)
+            : operand(_operand), width(_operand.expr_width()), shamt(_shamt) {}
+
+    size_t expr_width() const { return width; }
+
+    uint64_t expr_word(size_t i) const {
+        size_t word_shamt = shamt / 64;
+        size_t word_offset = shamt % 64;
+        if (i >= (width + 63) / 64 || i < word_shamt)
+            return 0;
+
+        size_t src = i - word_shamt;
+        uint64_t word = operand.expr_word(src) << word_offset;
+        if (word_offset != 0 && src > 0)
+            word |= operand.expr_word(src - 1) >> (64 - word_offset);
+        if (i == (width - 1) / 64 && width % 64 != 0)
+            word &= (~((uint64_t) 0)) >> (64 - width % 64);
+        return word;
+    }
+
+    bool expr_reads(const Bits *bits) const { return operand.expr_reads(bits); }
+
+private:
+    typename BitsExprOperand<E>::type operand;
+    size_t width;
+    size_t shamt;
+};
+
+template<class E>
+class BitsShiftRightExpr : public BitsExpr<BitsShiftRightExpr<E> > {
+public:
+    BitsShiftRightExpr(const E &_operand, size_t _shamt)
+            : operand(_operand), width(_operand.expr_width()), shamt(_shamt) {}
+
+    size_t expr_width() const { return width; }
+
+    uint64_t expr_word(size_t i) const {
+        if (i >= (width + 63) / 64 || shamt >= width)
+            return 0;
+
+        size_t src = i + shamt / 64;
+        size_t word_offset = shamt % 64;
+        uint64_t word = operand.expr_word(src) >> word_offset;
+        if (word_offset != 0)
+            word |= operand.expr_word(src + 1) << (64 - word_offset);
+        return word;
+    }
+
+    bool expr_reads(const Bits *bits) const { return operand.expr_reads(bits); }
+
+private:
+    typename BitsExprOperand<E>::type operand;
+    size_t width;
+    size_t shamt;
 };
 
-std::ostream &operator<<(std::ostream &o, Bits bits);
+// both sides must have the same width, will not sign or zero extend before
+// checking
+template<class L, class R>
+inline bool operator==(const BitsExpr<L> &left, const BitsExpr<R> &right) {
+    if (left.expr_width() != right.expr_width())
+        return false;
+    for (size_t i = 0; i < (left.expr_width() + 63) / 64; i++) {
+        if (left.expr_word(i) != right.expr_word(i))
+            return false;
+    }
+    return true;
+}
+
+template<class L, class R>
+inline bool operator!=(const BitsExpr<L> &left, const BitsExpr<R> &right) {
+    return !(left == right);
+}
+
+template<class E>
+void Bits::assign_expr(const BitsExpr<E> &expr) {
+    width = expr.expr_width();
+    num_words = (width + WORD_LEN - 1) / WORD_LEN;
+    data.resize(num_words);
+    for (size_t i = 0; i < num_words; i++)
+        data[i] = expr.expr_word(i);
+}
+
+template<class Op, class E>
+Bits &Bits::apply_expr(const BitsExpr<E> &operand) {
+    if (operand.expr_reads(this)) {
+        Bits value(operand);
+        return apply_expr<Op>(value);
+    }
+    for (size_t i = 0; i < num_words; i++)
+        data[i] = Op::apply(data[i], operand.expr_word(i));
+    clear_unused_bits();
+    return *this;
+}
+
+template<class E>
+Bits &Bits::operator^=(const BitsExpr<E> &operand) {
+    return apply_expr<BitsXorOp>(operand);
+}
+
+template<class E>
+Bits &Bits::operator|=(const BitsExpr<E> &operand) {
+    return apply_expr<BitsOrOp>(operand);
+}
+
+template<class E>
+Bits &Bits::operator&=(const BitsExpr<E> &operand) {
+    return apply_expr<BitsAndOp>(operand);
+}
 
 #endif
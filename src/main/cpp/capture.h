@@ -0,0 +1,331 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "port_layout.h"
+
+// binary capture file: a CaptureHeader, then for every port a u32 width, a
+// u16 name length and the name, then num_records records. Record i holds the
+// output ports at the end of cycle first_cycle + i. Without CAPTURE_DELTA a
+// record is the value of every port stored like its verilator field, in port
+// order and host byte order. With CAPTURE_DELTA a record is a u32 count of
+// changed ports followed by a u32 port index and the new value of each port
+// that changed since the previous record, the first record lists all ports.
+struct CaptureHeader {
+    char magic[8];
+    uint64_t layout_hash;
+    uint32_t num_ports;
+    uint32_t record_bytes;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t first_cycle;
+    uint64_t num_records;
+};
+
+static const char capture_magic[8] = {'V', 'T', 'E', 'C', 'A', 'P', 'T', '1'};
+
+static const uint32_t CAPTURE_DELTA = 1;
+
+// records the value of a set of ports every time sample() is called
+class OutputCapture {
+public:
+    OutputCapture() : file(NULL), delta(false), num_records(0) {}
+
+    OutputCapture(const OutputCapture &) = delete;
+
+    OutputCapture &operator=(const OutputCapture &) = delete;
+
+    ~OutputCapture() {
+        close();
+    }
+
+    bool open(const char *path, const std::vector<PortDescriptor> &ports, bool _delta, unsigned long first_cycle) {
+        close();
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+        delta = _delta;
+        num_records = 0;
+        fields.clear();
+        size_t offset = 0;
+        for (const PortDescriptor &port : ports) {
+            Field field = {port.field, port.bytes, offset};
+            fields.push_back(field);
+            offset += port.bytes;
+        }
+        current.assign(offset, 0);
+        previous.assign(offset, 0);
+
+        memcpy(header.magic, capture_magic, sizeof(capture_magic));
+        header.layout_hash = port_layout_hash(ports);
+        header.num_ports = (uint32_t) ports.size();
+        header.record_bytes = (uint32_t) offset;
+        header.flags = delta ? CAPTURE_DELTA : 0;
+        header.reserved = 0;
+        header.first_cycle = first_cycle;
+        header.num_records = 0;
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (const PortDescriptor &port : ports) {
+            uint32_t width = (uint32_t) port.width;
+            uint16_t length = (uint16_t) port.name.size();
+            fwrite(&width, sizeof(width), 1, file);
+            fwrite(&length, sizeof(length), 1, file);
+            fwrite(port.name.data(), 1, length, file);
+        }
+        return true;
+    }
+
+    bool is_open() const {
+        return file != NULL;
+    }
+
+    // appends the current value of the ports as the next record
+    void sample() {
+        if (!delta) {
+            for (const Field &field : fields)
+                memcpy(&current[field.offset], field.src, field.bytes);
+            fwrite(current.data(), 1, current.size(), file);
+        } else {
+            changed.clear();
+            for (uint32_t i = 0; i < fields.size(); i++) {
+                const Field &field = fields[i];
+                if (num_records == 0 || memcmp(&previous[field.offset], field.src, field.bytes) != 0) {
+                    memcpy(&previous[field.offset], field.src, field.bytes);
+                    changed.push_back(i);
+                }
+            }
+            uint32_t num_changed = (uint32_t) changed.size();
+            fwrite(&num_changed, sizeof(num_changed), 1, file);
+            for (uint32_t i : changed) {
+                fwrite(&i, sizeof(i), 1, file);
+                fwrite(&previous[fields[i].offset], 1, fields[i].bytes, file);
+            }
+        }
+        num_records++;
+    }
+
+    // fills in the record count and closes the file
+    bool close() {
+        if (!file)
+            return true;
+
+        header.num_records = num_records;
+        bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+        return ok;
+    }
+
+    // closes the file without filling in the record count, for a forked
+    // process that shares the file with its parent and must leave it alone
+    void detach() {
+        if (file) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+private:
+    struct Field {
+        const void *src;
+        size_t bytes;
+        size_t offset;
+    };
+
+    FILE *file;
+    bool delta;
+    uint64_t num_records;
+    CaptureHeader header;
+    std::vector<Field> fields;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> previous;
+    std::vector<uint32_t> changed;
+};
+
+// memory maps a capture file and decodes its records in order into full
+// records
+class CaptureReader {
+public:
+    CaptureReader() : cursor(NULL), end(NULL), next_record(0) {}
+
+    bool open(const char *path, std::string &error) {
+        if (!file.open(path)) {
+            error = std::string("cannot map capture file ") + path;
+            return false;
+        }
+
+        const uint8_t *data = file.get_data();
+        end = data + file.get_size();
+        if (file.get_size() < sizeof(header)) {
+            error = std::string("capture file too short: ") + path;
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, capture_magic, sizeof(capture_magic)) != 0) {
+            error = std::string("not a capture file: ") + path;
+            return false;
+        }
+
+        cursor = data + sizeof(header);
+        names.clear();
+        widths.clear();
+        offsets.clear();
+        sizes.clear();
+        size_t offset = 0;
+        for (uint32_t i = 0; i < header.num_ports; i++) {
+            uint32_t width;
+            uint16_t length;
+            if (!read(&width, sizeof(width)) || !read(&length, sizeof(length)) || end - cursor < length) {
+                error = std::string("capture file port table is truncated: ") + path;
+                return false;
+            }
+            names.push_back(std::string((const char *) cursor, length));
+            cursor += length;
+            widths.push_back(width);
+            offsets.push_back(offset);
+            sizes.push_back(PortDescriptor::field_bytes(width));
+            offset += sizes.back();
+        }
+        if (offset != header.record_bytes) {
+            error = std::string("capture file port table does not match its record size: ") + path;
+            return false;
+        }
+
+        record.assign(header.record_bytes, 0);
+        next_record = 0;
+        return true;
+    }
+
+    const CaptureHeader &get_header() const {
+        return header;
+    }
+
+    const std::string &get_port_name(size_t port) const {
+        return names[port];
+    }
+
+    size_t get_port_offset(size_t port) const {
+        return offsets[port];
+    }
+
+    size_t get_port_bytes(size_t port) const {
+        return sizes[port];
+    }
+
+    // decodes the next record, returns NULL after the last one or if the
+    // file is truncated
+    const uint8_t *next() {
+        if (next_record >= header.num_records)
+            return NULL;
+
+        if (!(header.flags & CAPTURE_DELTA)) {
+            if ((size_t) (end - cursor) < record.size())
+                return NULL;
+            memcpy(record.data(), cursor, record.size());
+            cursor += record.size();
+        } else {
+            uint32_t num_changed;
+            if (!read(&num_changed, sizeof(num_changed)))
+                return NULL;
+            for (uint32_t i = 0; i < num_changed; i++) {
+                uint32_t port;
+                if (!read(&port, sizeof(port)) || port >= header.num_ports ||
+                    !read(&record[offsets[port]], sizes[port]))
+                    return NULL;
+            }
+        }
+        next_record++;
+        return record.data();
+    }
+
+private:
+    MappedFile file;
+    CaptureHeader header;
+    const uint8_t *cursor;
+    const uint8_t *end;
+    uint64_t next_record;
+    std::vector<std::string> names;
+    std::vector<uint32_t> widths;
+    std::vector<size_t> offsets;
+    std::vector<size_t> sizes;
+    std::vector<uint8_t> record;
+
+    bool read(void *dst, size_t bytes) {
+        if ((size_t) (end - cursor) < bytes)
+            return false;
+        memcpy(dst, cursor, bytes);
+        cursor += bytes;
+        return true;
+    }
+};
+
+// result of compare_captures
+struct CaptureDiff {
+    bool identical;
+    // cycle of the first difference
+    uint64_t cycle;
+    // name of the first differing port, empty if the files differ in length
+    std::string port;
+    // set if the files cannot be compared at all
+    std::string error;
+};
+
+// compares the capture file at actual_path against the one at golden_path
+// record by record, filling in the first cycle and port that differ
+inline bool compare_captures(const char *golden_path, const char *actual_path, CaptureDiff &diff) {
+    diff.identical = false;
+    diff.cycle = 0;
+    diff.port.clear();
+    diff.error.clear();
+
+    CaptureReader golden, actual;
+    if (!golden.open(golden_path, diff.error) || !actual.open(actual_path, diff.error))
+        return false;
+
+    const CaptureHeader &golden_header = golden.get_header();
+    const CaptureHeader &actual_header = actual.get_header();
+    if (golden_header.layout_hash != actual_header.layout_hash ||
+        golden_header.num_ports != actual_header.num_ports) {
+        diff.error = "capture files were recorded for different port layouts";
+        return false;
+    }
+    if (golden_header.first_cycle != actual_header.first_cycle) {
+        diff.error = "capture files start at different cycles";
+        return false;
+    }
+
+    uint64_t cycle = golden_header.first_cycle;
+    while (true) {
+        const uint8_t *golden_record = golden.next();
+        const uint8_t *actual_record = actual.next();
+        if (!golden_record || !actual_record) {
+            diff.identical = !golden_record && !actual_record &&
+                             golden_header.num_records == actual_header.num_records;
+            diff.cycle = cycle;
+            return true;
+        }
+
+        if (memcmp(golden_record, actual_record, golden_header.record_bytes) != 0) {
+            for (size_t port = 0; port < golden_header.num_ports; port++) {
+                size_t offset = golden.get_port_offset(port);
+                if (memcmp(golden_record + offset, actual_record + offset, golden.get_port_bytes(port)) != 0) {
+                    diff.port = golden.get_port_name(port);
+                    break;
+                }
+            }
+            diff.cycle = cycle;
+            return true;
+        }
+        cycle++;
+    }
+}
+
+#endif
@@ -0,0 +1,34 @@
+// compares two capture files written by Testbench::start_capture and reports
+// the first cycle and output port where they differ
+//
+// build: c++ -std=c++11 -o capture_diff capture_diff.cpp
+// usage: capture_diff <golden capture> <actual capture>
+// exits with 0 if the captures are identical, 1 if they differ and 2 if they
+// cannot be compared
+
+#include <iostream>
+#include "capture.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <golden capture> <actual capture>" << std::endl;
+        return 2;
+    }
+
+    CaptureDiff diff;
+    if (!compare_captures(argv[1], argv[2], diff)) {
+        std::cerr << diff.error << std::endl;
+        return 2;
+    }
+
+    if (diff.identical) {
+        std::cout << "IDENTICAL" << std::endl;
+        return 0;
+    }
+
+    if (diff.port.empty())
+        std::cout << "DIFFER AT CYCLE " << diff.cycle << ": captures have different lengths" << std::endl;
+    else
+        std::cout << "DIFFER AT CYCLE " << diff.cycle << " " << diff.port << std::endl;
+    return 1;
+}
@@ -0,0 +1,99 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <verilated_save.h>
+
+// CheckpointSave and CheckpointRestore use the protected members of
+// VerilatedSerialize and VerilatedDeserialize (m_bufp, m_cp, m_endp,
+// m_isOpen, bufferSize() and header()), which have these names and meanings
+// in Verilator 4.0 through 5.x
+
+// serialized state of a model and its testbench held in memory, written by
+// Testbench::checkpoint(Checkpoint&) and restored any number of times by
+// Testbench::restore(const Checkpoint&)
+class Checkpoint {
+public:
+    bool empty() const { return data.empty(); }
+
+    size_t size() const { return data.size(); }
+
+    void clear() { data.clear(); }
+
+private:
+    std::vector<uint8_t> data;
+
+    friend class CheckpointSave;
+    friend class CheckpointRestore;
+};
+
+// VerilatedSerialize that appends to a Checkpoint instead of writing a file
+class CheckpointSave : public VerilatedSerialize {
+public:
+    explicit CheckpointSave(Checkpoint &_checkpoint) : checkpoint(_checkpoint) {
+        checkpoint.data.clear();
+        m_isOpen = true;
+        header();
+    }
+
+    virtual ~CheckpointSave() { close(); }
+
+    virtual void close() {
+        if (!m_isOpen)
+            return;
+        flush();
+        m_isOpen = false;
+    }
+
+    // moves the serialization buffer to the end of the checkpoint
+    virtual void flush() {
+        checkpoint.data.insert(checkpoint.data.end(), m_bufp, m_cp);
+        m_cp = m_bufp;
+    }
+
+private:
+    Checkpoint &checkpoint;
+};
+
+// VerilatedDeserialize that reads from a Checkpoint instead of a file
+class CheckpointRestore : public VerilatedDeserialize {
+public:
+    explicit CheckpointRestore(const Checkpoint &_checkpoint) : checkpoint(_checkpoint), position(0) {
+        // VerilatedDeserialize starts with m_endp null, VerilatedRestore::open
+        // sets both pointers the same way before reading the header
+        m_cp = m_endp = m_bufp;
+        m_isOpen = true;
+        header();
+    }
+
+    virtual ~CheckpointRestore() { close(); }
+
+    virtual void close() { m_isOpen = false; }
+
+    // moves the unread part of the buffer to its start and refills the rest
+    // from the checkpoint
+    virtual void fill() {
+        size_t remaining = m_endp - m_cp;
+        memmove(m_bufp, m_cp, remaining);
+        m_cp = m_bufp;
+        m_endp = m_bufp + remaining;
+
+        size_t available = checkpoint.data.size() - position;
+        if (available == 0)
+            return;
+        size_t space = bufferSize() - remaining;
+        size_t num_bytes = available < space ? available : space;
+        memcpy(m_endp, checkpoint.data.data() + position, num_bytes);
+        m_endp += num_bytes;
+        position += num_bytes;
+    }
+
+private:
+    const Checkpoint &checkpoint;
+    size_t position;
+};
+
+#endif
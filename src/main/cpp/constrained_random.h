@@ -0,0 +1,277 @@
+#ifndef CONSTRAINED_RANDOM_H
+#define CONSTRAINED_RANDOM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "bits.h"
+#include "port_layout.h"
+#include "rng.h"
+#include "veri_api.h"
+
+// constraint on the random values of one input port. A field is uniformly
+// random over its width until it is constrained, the constraint methods
+// return the field so they can be chained, e.g.
+// field.weighted(0, 0, 1).weighted(1, 15, 3).fixed(0x1, 0x1)
+class RandomField {
+public:
+    enum Kind {
+        UNIFORM,
+        RANGE,
+        WEIGHTED,
+        ONE_HOT
+    };
+
+    explicit RandomField(const PortDescriptor &_port)
+            : port(_port), kind(UNIFORM), enabled(true), lo(0), hi(0), total_weight(0) {}
+
+    // uniformly random over the whole width
+    RandomField &uniform() {
+        kind = UNIFORM;
+        return *this;
+    }
+
+    // uniformly random in [_lo, _hi], for fields of up to 64 bits
+    RandomField &range(uint64_t _lo, uint64_t _hi) {
+        assert(port.width <= 64 && _lo <= _hi && _hi <= width_mask());
+        kind = RANGE;
+        lo = _lo;
+        hi = _hi;
+        return *this;
+    }
+
+    RandomField &constant(uint64_t value) {
+        return range(value, value);
+    }
+
+    // adds a bucket that is picked with probability weight over the total
+    // weight of all buckets, the value is then uniformly random in
+    // [_lo, _hi]. The first call after another constraint replaces it, for
+    // fields of up to 64 bits
+    RandomField &weighted(uint64_t _lo, uint64_t _hi, uint64_t weight) {
+        assert(port.width <= 64 && _lo <= _hi && _hi <= width_mask() && weight > 0);
+        if (kind != WEIGHTED) {
+            buckets.clear();
+            total_weight = 0;
+        }
+        kind = WEIGHTED;
+        total_weight += weight;
+        Bucket bucket = {_lo, _hi, total_weight};
+        buckets.push_back(bucket);
+        return *this;
+    }
+
+    // exactly one bit set, uniformly chosen
+    RandomField &one_hot() {
+        kind = ONE_HOT;
+        return *this;
+    }
+
+    // forces the bits set in mask to their value in value, on top of the
+    // other constraint, e.g. to keep an opcode or an alignment
+    RandomField &fixed(uint64_t mask, uint64_t value) {
+        return fixed(0, port.width < 64 ? port.width : 64, mask, value);
+    }
+
+    // same as fixed(mask, value) for the len bits, at most 64, starting at
+    // bit field_lo, for fields of any width
+    RandomField &fixed(size_t field_lo, size_t len, uint64_t mask, uint64_t value) {
+        assert(field_lo + len <= port.width);
+        fixed_mask.resize((port.width + 63) / 64);
+        fixed_value.resize((port.width + 63) / 64);
+        uint64_t old_mask = bits_extract_words(fixed_mask.data(), field_lo, len);
+        uint64_t old_value = bits_extract_words(fixed_value.data(), field_lo, len);
+        bits_insert_words(fixed_mask.data(), field_lo, len, old_mask | mask);
+        bits_insert_words(fixed_value.data(), field_lo, len, (old_value & ~mask) | (value & mask));
+        return *this;
+    }
+
+    // forgets the fixed bits
+    RandomField &unfixed() {
+        fixed_mask.clear();
+        fixed_value.clear();
+        return *this;
+    }
+
+    // a disabled field keeps whatever value it has, e.g. for a valid or
+    // ready signal driven by the test itself
+    RandomField &disable() {
+        enabled = false;
+        return *this;
+    }
+
+    RandomField &enable() {
+        enabled = true;
+        return *this;
+    }
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    const std::string &get_name() const {
+        return port.name;
+    }
+
+    size_t get_width() const {
+        return port.width;
+    }
+
+    // writes a new value into the port, does not allocate
+    void generate(Rng &rng) {
+        if (!enabled)
+            return;
+
+        if (port.width <= 64) {
+            uint64_t value = draw(rng);
+            if (!fixed_mask.empty())
+                value = (value & ~fixed_mask[0]) | fixed_value[0];
+            // verilator fields of up to 64 bits are CData to QData
+            memcpy(port.field, &value, port.bytes);
+            return;
+        }
+
+        uint32_t *words = (uint32_t *) port.field;
+        size_t one_hot_bit = kind == ONE_HOT ? rng.below(port.width) : 0;
+        for (size_t i = 0; i * 64 < port.width; i++) {
+            size_t len = port.width - i * 64 < 64 ? port.width - i * 64 : 64;
+            uint64_t chunk;
+            if (kind == ONE_HOT)
+                chunk = one_hot_bit / 64 == i ? ((uint64_t) 1) << (one_hot_bit % 64) : 0;
+            else
+                chunk = rng.bits(len);
+            if (!fixed_mask.empty())
+                chunk = (chunk & ~fixed_mask[i]) | fixed_value[i];
+            bits_insert_words(words, i * 64, len, chunk);
+        }
+    }
+
+private:
+    struct Bucket {
+        uint64_t lo;
+        uint64_t hi;
+        // sum of the weights of this and all earlier buckets
+        uint64_t cumulative_weight;
+    };
+
+    PortDescriptor port;
+    Kind kind;
+    bool enabled;
+    uint64_t lo;
+    uint64_t hi;
+    std::vector<Bucket> buckets;
+    uint64_t total_weight;
+    // one bit per bit of the field, in 64 bit words, empty if nothing is
+    // fixed
+    std::vector<uint64_t> fixed_mask;
+    std::vector<uint64_t> fixed_value;
+
+    uint64_t width_mask() const {
+        return port.width >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << port.width) - 1;
+    }
+
+    // uniformly random in [range_lo, range_hi]
+    static uint64_t draw_range(Rng &rng, uint64_t range_lo, uint64_t range_hi) {
+        uint64_t span = range_hi - range_lo;
+        return span == ~((uint64_t) 0) ? rng.next() : range_lo + rng.below(span + 1);
+    }
+
+    // a value of a field of up to 64 bits before the fixed bits
+    uint64_t draw(Rng &rng) {
+        switch (kind) {
+            case RANGE:
+                return draw_range(rng, lo, hi);
+            case WEIGHTED: {
+                uint64_t pick = rng.below(total_weight);
+                size_t b = 0;
+                while (pick >= buckets[b].cumulative_weight)
+                    b++;
+                return draw_range(rng, buckets[b].lo, buckets[b].hi);
+            }
+            case ONE_HOT:
+                return ((uint64_t) 1) << rng.below(port.width);
+            default:
+                return rng.bits(port.width);
+        }
+    }
+};
+
+// constrained random stimulus over a set of input ports, filled by the
+// generated testbench with one field per input port, see
+// Testbench::get_random_inputs. Look fields up and constrain them once,
+// randomize() then writes every enabled field straight into the dut without
+// building Bits or looking up names.
+class ConstrainedRandom {
+public:
+    // references to fields stay valid until the next add
+    RandomField &add(const PortDescriptor &port) {
+        fields.push_back(RandomField(port));
+        return fields.back();
+    }
+
+    bool empty() const {
+        return fields.empty();
+    }
+
+    size_t size() const {
+        return fields.size();
+    }
+
+    RandomField &operator[](size_t i) {
+        return fields[i];
+    }
+
+    // the field of the port called name, e.g. "io_req_bits_addr", NULL if
+    // there is none
+    RandomField *find(const std::string &name) {
+        for (RandomField &field : fields) {
+            if (field.get_name() == name)
+                return &field;
+        }
+        return NULL;
+    }
+
+    RandomField &field(const std::string &name) {
+        RandomField *found = find(name);
+        if (!found) {
+            std::cout << "tried to constrain nonexistent input: " << name << std::endl;
+            assert(false);
+        }
+        return *found;
+    }
+
+    // the field of wire, e.g. field(tb.io.req.bits.addr) or the handle
+    // returned by VerilatorBundle::resolve
+    RandomField &field(VerilatorDataWrapper &wire) {
+        return field(wire.get_name());
+    }
+
+    // disables every field whose name does not start with prefix, e.g.
+    // "io_req_" to only randomize the fields of io.req
+    void only(const std::string &prefix) {
+        for (RandomField &field : fields) {
+            if (field.get_name().compare(0, prefix.size(), prefix) != 0)
+                field.disable();
+        }
+    }
+
+    void enable_all() {
+        for (RandomField &field : fields)
+            field.enable();
+    }
+
+    // writes new values into every enabled field
+    void randomize(Rng &rng) {
+        for (RandomField &field : fields)
+            field.generate(rng);
+    }
+
+private:
+    std::vector<RandomField> fields;
+};
+
+#endif
@@ -0,0 +1,20 @@
+// prints a binary event log written by Testbench::open_event_log as text
+//
+// build: c++ -std=c++11 -o event_log_print event_log_print.cpp bits.cpp
+// usage: event_log_print <event log>
+
+#include <iostream>
+#include "testbench_log.h"
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <event log>" << std::endl;
+        return 2;
+    }
+
+    if (!print_event_log(argv[1], std::cout)) {
+        std::cerr << "could not read event log " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#ifndef EXPECT_BATCH_H
+#define EXPECT_BATCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "veri_api.h"
+#include "bits.h"
+
+// set of (wire, expected value, mask) checks that are sampled and compared
+// together. Expected values, masks and sampled values of all checks are
+// packed into three contiguous word buffers so that the comparison is a
+// single branch free pass the compiler can vectorize, individual checks are
+// only looked at when that pass finds a difference.
+class ExpectBatch {
+public:
+    // adds a check of wire against expected, only bits set in mask are
+    // compared, a NULL mask compares all bits of the wire
+    void add(VerilatorDataWrapper &wire, const Bits &expected, const Bits *mask) {
+        size_t width = wire.get_width();
+        size_t num_words = (width + 63) / 64;
+        Check check = {&wire, expected_words.size(), num_words, mask != NULL};
+        checks.push_back(check);
+
+        size_t expected_words_in = (expected.get_width() + 63) / 64;
+        size_t mask_words_in = mask ? (mask->get_width() + 63) / 64 : 0;
+        for (size_t i = 0; i < num_words; i++) {
+            uint64_t valid = (i == num_words - 1 && width % 64 != 0) ? (~((uint64_t) 0)) >> (64 - width % 64)
+                                                                     : ~((uint64_t) 0);
+            uint64_t mask_word = mask ? (i < mask_words_in ? mask->get_word(i) : 0) : ~((uint64_t) 0);
+            expected_words.push_back(i < expected_words_in ? expected.get_word(i) & valid : 0);
+            mask_words.push_back(mask_word & valid);
+        }
+    }
+
+    size_t size() const {
+        return checks.size();
+    }
+
+    bool empty() const {
+        return checks.empty();
+    }
+
+    void clear() {
+        checks.clear();
+        expected_words.clear();
+        mask_words.clear();
+        actual_words.clear();
+    }
+
+    // copies the current value of every checked wire straight into its
+    // words of the actual buffer, see VerilatorDataWrapper::get_words
+    void sample() {
+        actual_words.resize(expected_words.size());
+        for (size_t c = 0; c < checks.size(); c++)
+            checks[c].wire->get_words(&actual_words[checks[c].offset]);
+    }
+
+    // true if any sampled value differs from its expected value in the bits
+    // selected by its mask
+    bool any_mismatch() const {
+        const uint64_t *actual = actual_words.data();
+        const uint64_t *expected = expected_words.data();
+        const uint64_t *mask = mask_words.data();
+        uint64_t diff = 0;
+        for (size_t i = 0; i < expected_words.size(); i++)
+            diff |= (actual[i] ^ expected[i]) & mask[i];
+        return diff != 0;
+    }
+
+    bool mismatch(size_t c) const {
+        for (size_t i = checks[c].offset; i < checks[c].offset + checks[c].num_words; i++)
+            if ((actual_words[i] ^ expected_words[i]) & mask_words[i])
+                return true;
+        return false;
+    }
+
+    VerilatorDataWrapper &get_wire(size_t c) const {
+        return *checks[c].wire;
+    }
+
+    Bits get_actual(size_t c) const {
+        return to_bits(c, actual_words);
+    }
+
+    Bits get_expected(size_t c) const {
+        return to_bits(c, expected_words);
+    }
+
+    Bits get_mask(size_t c) const {
+        return to_bits(c, mask_words);
+    }
+
+    // true if check c was added with a mask
+    bool is_masked(size_t c) const {
+        return checks[c].masked;
+    }
+
+private:
+    struct Check {
+        VerilatorDataWrapper *wire;
+        // position of the first word of this check in the word buffers
+        size_t offset;
+        size_t num_words;
+        bool masked;
+    };
+
+    std::vector<Check> checks;
+    std::vector<uint64_t> expected_words;
+    std::vector<uint64_t> mask_words;
+    std::vector<uint64_t> actual_words;
+
+    Bits to_bits(size_t c, const std::vector<uint64_t> &words) const {
+        Bits result = Bits::zeros(checks[c].wire->get_width());
+        for (size_t i = 0; i < checks[c].num_words; i++)
+            result.set_word(i, words[checks[c].offset + i]);
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef FIXED_BITS_H
+#define FIXED_BITS_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include "bits.h"
+
+// W bit wide value with compile time width, stored in a std::array so that
+// no operation allocates or checks widths at runtime. Bits above W are kept
+// zero by every operation.
+template<size_t W>
+class FixedBits {
+    static_assert(W > 0, "FixedBits width must be positive");
+
+public:
+    static const size_t WORD_LEN = 64;
+    static const size_t NUM_WORDS = (W + WORD_LEN - 1) / WORD_LEN;
+
+    // valid bits of the highest word
+    static constexpr uint64_t TOP_MASK = (~((uint64_t) 0)) >> (NUM_WORDS * WORD_LEN - W);
+
+    FixedBits() : words() {}
+
+    // value is truncated to W bits
+    FixedBits(uint64_t value) : words() {
+        words[0] = value;
+        mask_top();
+    }
+
+    // truncates or zero-extends bits to W bits
+    explicit FixedBits(const Bits &bits) : words() {
+        size_t bits_words = (bits.get_width() + WORD_LEN - 1) / WORD_LEN;
+        for (size_t i = 0; i < NUM_WORDS && i < bits_words; i++)
+            words[i] = bits.get_word(i);
+        mask_top();
+    }
+
+    static FixedBits zeros() {
+        return FixedBits();
+    }
+
+    // packs verilator WData words, src[0] holding the lowest 32 bits
+    static FixedBits from_words32(const uint32_t *src) {
+        FixedBits result;
+        for (size_t i = 0; i < (W + 31) / 32; i++)
+            result.words[i / 2] |= ((uint64_t) src[i]) << ((i % 2) * 32);
+        result.mask_top();
+        return result;
+    }
+
+    // unpacks into verilator WData words, dst[0] receiving the lowest 32 bits
+    void to_words32(uint32_t *dst) const {
+        for (size_t i = 0; i < (W + 31) / 32; i++)
+            dst[i] = (uint32_t) (words[i / 2] >> ((i % 2) * 32));
+    }
+
+    Bits to_bits() const {
+        Bits result = Bits::zeros(W);
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            result.set_word(i, words[i]);
+        return result;
+    }
+
+    uint64_t to_uint64() const {
+        return words[0];
+    }
+
+    size_t get_width() const {
+        return W;
+    }
+
+    uint64_t get_word(size_t i) const {
+        return words[i];
+    }
+
+    void set_word(size_t i, uint64_t word) {
+        words[i] = word;
+        if (i == NUM_WORDS - 1)
+            mask_top();
+    }
+
+    FixedBits &operator&=(const FixedBits &operand) {
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            words[i] &= operand.words[i];
+        return *this;
+    }
+
+    FixedBits &operator|=(const FixedBits &operand) {
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            words[i] |= operand.words[i];
+        return *this;
+    }
+
+    FixedBits &operator^=(const FixedBits &operand) {
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            words[i] ^= operand.words[i];
+        return *this;
+    }
+
+    FixedBits &operator<<=(size_t shamt) {
+        if (shamt >= W) {
+            words.fill(0);
+            return *this;
+        }
+
+        size_t word_shamt = shamt / WORD_LEN;
+        size_t word_offset = shamt % WORD_LEN;
+        for (size_t i = NUM_WORDS; i-- > 0;) {
+            uint64_t word = i >= word_shamt ? words[i - word_shamt] << word_offset : 0;
+            if (word_offset != 0 && i >= word_shamt + 1)
+                word |= words[i - word_shamt - 1] >> (WORD_LEN - word_offset);
+            words[i] = word;
+        }
+        mask_top();
+        return *this;
+    }
+
+    FixedBits &operator>>=(size_t shamt) {
+        if (shamt >= W) {
+            words.fill(0);
+            return *this;
+        }
+
+        size_t word_shamt = shamt / WORD_LEN;
+        size_t word_offset = shamt % WORD_LEN;
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            size_t src = i + word_shamt;
+            uint64_t word = src < NUM_WORDS ? words[src] >> word_offset : 0;
+            if (word_offset != 0 && src + 1 < NUM_WORDS)
+                word |= words[src + 1] << (WORD_LEN - word_offset);
+            words[i] = word;
+        }
+        return *this;
+    }
+
+    FixedBits operator&(const FixedBits &operand) const {
+        FixedBits result(*this);
+        return result &= operand;
+    }
+
+    FixedBits operator|(const FixedBits &operand) const {
+        FixedBits result(*this);
+        return result |= operand;
+    }
+
+    FixedBits operator^(const FixedBits &operand) const {
+        FixedBits result(*this);
+        return result ^= operand;
+    }
+
+    FixedBits operator<<(size_t shamt) const {
+        FixedBits result(*this);
+        return result <<= shamt;
+    }
+
+    FixedBits operator>>(size_t shamt) const {
+        FixedBits result(*this);
+        return result >>= shamt;
+    }
+
+    FixedBits operator~() const {
+        FixedBits result;
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            result.words[i] = ~words[i];
+        result.mask_top();
+        return result;
+    }
+
+    bool operator==(const FixedBits &operand) const {
+        return words == operand.words;
+    }
+
+    bool operator!=(const FixedBits &operand) const {
+        return words != operand.words;
+    }
+
+    // inputs the hexadecimal representation of this instance to o, in the
+    // same format as Bits::print
+    std::ostream &print(std::ostream &o) const {
+        std::ios state(NULL);
+        state.copyfmt(o);
+        o << "0x";
+        for (size_t i = NUM_WORDS - 1; i >= 1; i--)
+            o << std::hex << words[i] << " ";
+        o << std::hex << words[0];
+
+        o.copyfmt(state);
+        return o;
+    }
+
+private:
+    std::array<uint64_t, NUM_WORDS> words;
+
+    void mask_top() {
+        words[NUM_WORDS - 1] &= TOP_MASK;
+    }
+};
+
+template<size_t W>
+constexpr uint64_t FixedBits<W>::TOP_MASK;
+
+template<size_t W>
+std::ostream &operator<<(std::ostream &o, const FixedBits<W> &bits) {
+    return bits.print(o);
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "port_layout.h"
+#include "testbench_log.h"
+
+// keeps the values of a set of ports for the last depth cycles in a
+// preallocated ring of records, each record laid out like a stimulus or
+// capture record. Sampling is a memcpy per port, the records are only
+// formatted when the recorder is dumped.
+class FlightRecorder {
+public:
+    FlightRecorder() : depth(0), record_bytes(0), next(0), count(0) {}
+
+    void open(const std::vector<PortDescriptor> &ports, size_t _depth) {
+        fields.clear();
+        names.clear();
+        widths.clear();
+        record_bytes = 0;
+        for (const PortDescriptor &port : ports) {
+            Field field = {port.field, port.bytes, record_bytes};
+            fields.push_back(field);
+            names.push_back(port.name);
+            widths.push_back(port.width);
+            record_bytes += port.bytes;
+        }
+
+        depth = _depth;
+        records.assign(depth * record_bytes, 0);
+        cycles.assign(depth, 0);
+        next = 0;
+        count = 0;
+    }
+
+    void close() {
+        depth = 0;
+        records.clear();
+        cycles.clear();
+    }
+
+    bool is_open() const {
+        return depth != 0;
+    }
+
+    // overwrites the oldest record with the current port values
+    void sample(unsigned long cycle) {
+        uint8_t *record = &records[next * record_bytes];
+        for (const Field &field : fields)
+            memcpy(record + field.offset, field.src, field.bytes);
+        cycles[next] = cycle;
+        next = next + 1 == depth ? 0 : next + 1;
+        if (count < depth)
+            count++;
+    }
+
+    // writes the recorded cycles, oldest first, as a table with one row per
+    // cycle and one hexadecimal column per port
+    void dump_table(LogSink &log) const {
+        std::string line = "CYCLE";
+        for (const std::string &name : names)
+            line += "\t" + name;
+        log << line << "\n";
+
+        for (size_t r = 0; r < count; r++) {
+            size_t slot = (next + depth - count + r) % depth;
+            const uint8_t *record = &records[slot * record_bytes];
+            log << cycles[slot];
+            for (size_t p = 0; p < fields.size(); p++) {
+                line = "\t0x";
+                append_hex(line, record + fields[p].offset, fields[p].bytes);
+                log << line;
+            }
+            log << "\n";
+        }
+    }
+
+    // writes the recorded cycles as a VCD file with one time step per cycle,
+    // returns false if the file cannot be written
+    bool dump_vcd(const char *path, const std::string &scope) const {
+        FILE *file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        fprintf(file, "$timescale 1ns $end\n$scope module %s $end\n", scope.c_str());
+        for (size_t p = 0; p < names.size(); p++)
+            fprintf(file, "$var wire %zu %s %s $end\n", widths[p], vcd_id(p).c_str(), names[p].c_str());
+        fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+
+        std::string value;
+        for (size_t r = 0; r < count; r++) {
+            size_t slot = (next + depth - count + r) % depth;
+            const uint8_t *record = &records[slot * record_bytes];
+            fprintf(file, "#%lu\n", cycles[slot]);
+            for (size_t p = 0; p < fields.size(); p++) {
+                const uint8_t *bytes = record + fields[p].offset;
+                value.clear();
+                for (size_t bit = widths[p]; bit-- > 0;)
+                    value.push_back((bytes[bit / 8] >> (bit % 8)) & 1 ? '1' : '0');
+                if (widths[p] == 1)
+                    fprintf(file, "%s%s\n", value.c_str(), vcd_id(p).c_str());
+                else
+                    fprintf(file, "b%s %s\n", value.c_str(), vcd_id(p).c_str());
+            }
+        }
+
+        return fclose(file) == 0;
+    }
+
+private:
+    struct Field {
+        const void *src;
+        size_t bytes;
+        size_t offset;
+    };
+
+    std::vector<Field> fields;
+    std::vector<std::string> names;
+    std::vector<size_t> widths;
+    size_t depth;
+    size_t record_bytes;
+    std::vector<uint8_t> records;
+    std::vector<unsigned long> cycles;
+    // slot written by the next sample
+    size_t next;
+    // number of valid records
+    size_t count;
+
+    // hexadecimal digits of a little endian value without leading zeros
+    static void append_hex(std::string &out, const uint8_t *bytes, size_t num_bytes) {
+        static const char hex_digits[] = "0123456789abcdef";
+        size_t nibble = num_bytes * 2;
+        while (nibble > 1 && ((bytes[(nibble - 1) / 2] >> (((nibble - 1) % 2) * 4)) & 0xf) == 0)
+            nibble--;
+        while (nibble-- > 0)
+            out.push_back(hex_digits[(bytes[nibble / 2] >> ((nibble % 2) * 4)) & 0xf]);
+    }
+
+    // VCD identifier of port p, printable characters '!' to '~'
+    static std::string vcd_id(size_t p) {
+        std::string id;
+        do {
+            id.push_back((char) ('!' + p % 94));
+            p /= 94;
+        } while (p != 0);
+        return id;
+    }
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef FORK_RUNNER_H
+#define FORK_RUNNER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "testbench_log.h"
+
+// outcome of one child process started by run_forked
+struct ForkRunResult {
+    size_t index;
+    uint64_t seed;
+    bool failed;
+    unsigned long first_failed_cycle;
+    unsigned long cycles;
+    // status reported by waitpid
+    int status;
+    // false if the child ended without reporting, e.g. because it crashed
+    bool reported;
+    // errno of the pipe() or fork() that failed to start the child, ENOTSUP
+    // if run_forked refused to fork, 0 if the child started
+    int fork_errno;
+    // text output of the child, including the finish() summary
+    std::string output;
+};
+
+// fixed size part of the report a child writes to its pipe, followed by
+// output_bytes bytes of text output
+struct ForkChildReport {
+    uint64_t seed;
+    uint64_t first_failed_cycle;
+    uint64_t cycles;
+    uint64_t output_bytes;
+    uint8_t failed;
+};
+
+inline bool fork_write_all(int fd, const void *data, size_t size) {
+    const char *bytes = (const char *) data;
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+// reads from fd until end of file, returns everything read
+inline std::string fork_read_all(int fd) {
+    std::string data;
+    char buffer[1 << 16];
+    for (;;) {
+        ssize_t num_read = read(fd, buffer, sizeof(buffer));
+        if (num_read < 0 && errno == EINTR)
+            continue;
+        if (num_read <= 0)
+            break;
+        data.append(buffer, (size_t) num_read);
+    }
+    return data;
+}
+
+// runs child i of run_forked in the forked process and writes its report to
+// fd, returns true if it passed and the report was sent. An exception thrown
+// by the test fails the child and is reported in its output.
+template<class TB>
+bool fork_child_main(TB &tb, size_t i, uint64_t seed, int fd, std::function<void(TB &, size_t)> &body) {
+    tb.restart_scoreboards_after_fork();
+    tb.detach_outputs();
+    std::ostringstream output;
+    tb.log.set_stream(output);
+
+    tb.set_seed(seed);
+    std::string exception_message;
+    bool threw = false;
+    try {
+        if (body)
+            body(tb, i);
+        else
+            tb.run_on_this_thread();
+        tb.finish();
+    } catch (const std::exception &e) {
+        threw = true;
+        exception_message = e.what();
+    } catch (...) {
+        threw = true;
+        exception_message = "unknown exception";
+    }
+    if (threw) {
+        if (!tb.failed) {
+            tb.failed = true;
+            tb.first_failed_cycle = tb.m_tickcount;
+        }
+        if (tb.log_level >= LOG_FAILURES)
+            tb.log << "EXCEPTION AT " << tb.m_tickcount << "\t" << exception_message << "\n";
+        tb.log.flush();
+    }
+
+    std::string text = output.str();
+    ForkChildReport report;
+    report.seed = tb.seed;
+    report.first_failed_cycle = tb.failed ? tb.first_failed_cycle : 0;
+    report.cycles = tb.m_tickcount;
+    report.output_bytes = text.size();
+    report.failed = tb.failed;
+    bool sent = fork_write_all(fd, &report, sizeof(report)) &&
+                fork_write_all(fd, text.data(), text.size());
+    return sent && !tb.failed;
+}
+
+// forks num_children processes from tb, which has typically been reset and
+// warmed up already, so that every child starts from its state and shares
+// the model memory with the parent copy-on-write. At most max_running
+// children (0 for no limit) run at the same time.
+//
+// Child i sets the seed base_seed + i, runs body(tb, i), or tb.run() if body
+// is empty, calls finish() and exits with status 1 if it failed. Its text
+// output is collected by the parent instead of being printed, and results
+// receives one entry per child in index order. The trace, event log and
+// capture files of tb are only written by the parent, a child dumps its
+// flight recorder to its output. Scoreboards attached to tb are drained
+// before the first fork and keep checking in every child. A child that
+// throws fails with the exception in its output. Returns true if every
+// child passed.
+//
+// fork() only copies the calling thread, so no child is started if the
+// model runs on several threads or an FST trace is written on threads of
+// its own, see Testbench::single_threaded. A child that could not be
+// started fails with the errno in fork_errno.
+template<class TB>
+bool run_forked(TB &tb, size_t num_children, size_t max_running, uint64_t base_seed,
+                std::vector<ForkRunResult> &results,
+                std::function<void(TB &, size_t)> body = std::function<void(TB &, size_t)>()) {
+    if (max_running == 0 || max_running > num_children)
+        max_running = num_children;
+
+    results.assign(num_children, ForkRunResult());
+    std::vector<pid_t> pids(num_children, -1);
+    std::vector<int> pipes(num_children, -1);
+
+    int refused_errno = 0;
+    if (!tb.single_threaded()) {
+        refused_errno = ENOTSUP;
+        if (tb.log_level >= LOG_FAILURES)
+            tb.log << "RUN_FORKED NEEDS A SINGLE THREADED MODEL AND TRACE\n";
+    }
+
+    // a child must not inherit transactions only the checker threads of the
+    // parent know about
+    tb.drain_scoreboards();
+    // nothing buffered before the fork may be written twice
+    tb.log.flush();
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(NULL);
+
+    size_t next_child = 0;
+    size_t next_reap = 0;
+    while (next_reap < num_children) {
+        while (next_child < num_children && next_child - next_reap < max_running) {
+            size_t i = next_child++;
+            ForkRunResult &result = results[i];
+            result.index = i;
+            result.seed = base_seed + i;
+            result.failed = true;
+            result.first_failed_cycle = tb.m_tickcount;
+            result.cycles = tb.m_tickcount;
+            result.status = 0;
+            result.reported = false;
+            result.fork_errno = refused_errno;
+            if (refused_errno)
+                continue;
+
+            int fds[2];
+            if (pipe(fds) != 0) {
+                result.fork_errno = errno;
+                continue;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                bool passed = false;
+                // an exception must not unwind past the fork into the code
+                // of the parent
+                try {
+                    passed = fork_child_main(tb, i, base_seed + i, fds[1], body);
+                } catch (...) {
+                }
+                // no destructors or atexit handlers, they belong to the parent
+                _exit(passed ? 0 : 1);
+            }
+            if (pid < 0) {
+                result.fork_errno = errno;
+                close(fds[0]);
+                close(fds[1]);
+                continue;
+            }
+            close(fds[1]);
+            pids[i] = pid;
+            pipes[i] = fds[0];
+        }
+
+        // children are reaped in order, reading one pipe to its end while
+        // later children block on full pipes cannot deadlock
+        size_t i = next_reap++;
+        if (pids[i] < 0)
+            continue;
+        std::string data = fork_read_all(pipes[i]);
+        close(pipes[i]);
+        while (waitpid(pids[i], &results[i].status, 0) < 0 && errno == EINTR) {}
+
+        ForkChildReport report;
+        if (data.size() >= sizeof(report)) {
+            memcpy(&report, data.data(), sizeof(report));
+            if (data.size() == sizeof(report) + report.output_bytes) {
+                ForkRunResult &result = results[i];
+                result.seed = report.seed;
+                result.failed = report.failed != 0;
+                result.first_failed_cycle = report.first_failed_cycle;
+                result.cycles = report.cycles;
+                result.reported = true;
+                result.output = data.substr(sizeof(report));
+            }
+        }
+    }
+
+    bool passed = true;
+    for (const ForkRunResult &result : results)
+        passed = passed && !result.failed;
+    return passed;
+}
+
+// prints the output of every child in index order, one line per failed,
+// crashed or not started child and a PASSED/FAILED total line
+inline void print_fork_summary(const std::vector<ForkRunResult> &results, std::ostream &o) {
+    size_t num_failed = 0;
+    for (const ForkRunResult &result : results) {
+        o << "CHILD " << result.index << " SEED " << result.seed << "\n" << result.output;
+        if (result.fork_errno) {
+            num_failed++;
+            o << "CHILD " << result.index << " NOT STARTED: " << strerror(result.fork_errno) << "\n";
+        } else if (!result.reported) {
+            num_failed++;
+            o << "CHILD " << result.index << " ENDED WITHOUT REPORT";
+            if (WIFSIGNALED(result.status))
+                o << ", SIGNAL " << WTERMSIG(result.status);
+            o << "\n";
+        } else if (result.failed) {
+            num_failed++;
+            o << "CHILD " << result.index << " FAILED FIRST AT CYCLE " << result.first_failed_cycle << "\n";
+        }
+    }
+    o << "RAN " << results.size() << " CHILDREN ";
+    if (num_failed)
+        o << num_failed << " FAILED" << std::endl;
+    else
+        o << "PASSED" << std::endl;
+}
+
+#endif
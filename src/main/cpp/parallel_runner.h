@@ -0,0 +1,140 @@
+#ifndef PARALLEL_RUNNER_H
+#define PARALLEL_RUNNER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "testbench_log.h"
+
+// outcome of one testbench instance run by run_parallel
+struct ParallelRunResult {
+    size_t index;
+    uint64_t seed;
+    bool failed;
+    unsigned long first_failed_cycle;
+    unsigned long cycles;
+    // text output of the instance, including the finish() summary
+    std::string output;
+};
+
+// constructs, runs and finishes instance i of run_parallel with its text
+// output going to result.output. An exception fails the instance and is
+// reported in its output instead of escaping the worker thread.
+template<class TB>
+void run_parallel_instance(size_t i, uint64_t seed, const std::function<void(TB &, size_t)> &configure,
+                           ParallelRunResult &result) {
+    result.index = i;
+    result.seed = seed;
+    result.failed = true;
+    result.first_failed_cycle = 0;
+    result.cycles = 0;
+
+    std::ostringstream output;
+    try {
+        TB tb;
+        tb.log.set_stream(output);
+        tb.set_seed(seed);
+        std::string exception_message;
+        bool threw = false;
+        try {
+            if (configure)
+                configure(tb, i);
+            tb.run_on_this_thread();
+            tb.finish();
+        } catch (const std::exception &e) {
+            threw = true;
+            exception_message = e.what();
+        } catch (...) {
+            threw = true;
+            exception_message = "unknown exception";
+        }
+        if (threw) {
+            if (!tb.failed) {
+                tb.failed = true;
+                tb.first_failed_cycle = tb.m_tickcount;
+            }
+            if (tb.log_level >= LOG_FAILURES)
+                tb.log << "EXCEPTION AT " << tb.m_tickcount << "\t" << exception_message << "\n";
+        }
+        tb.log.flush();
+
+        result.seed = tb.seed;
+        result.failed = tb.failed;
+        result.first_failed_cycle = tb.failed ? tb.first_failed_cycle : 0;
+        result.cycles = tb.m_tickcount;
+    } catch (const std::exception &e) {
+        output << "EXCEPTION\t" << e.what() << "\n";
+    } catch (...) {
+        output << "EXCEPTION\tunknown exception\n";
+    }
+    result.output = output.str();
+}
+
+// runs num_instances independent instances of the testbench class TB on up
+// to num_threads worker threads (0 uses one per hardware thread). Instance i
+// is constructed on its worker, seeded with base_seed + i, passed to
+// configure (if set) and then run() and finish() are called on it. Its text
+// output is collected instead of being printed, so instances on different
+// threads do not interleave, and results receives one entry per instance in
+// index order, see print_parallel_summary. An instance that throws fails
+// with the exception in its output. Returns true if every instance passed.
+//
+// Instances only share no simulation state with verilator 4.202 and later,
+// where every model gets its own VerilatedContext; older verilator versions
+// keep the finish flag and other state global.
+template<class TB>
+bool run_parallel(size_t num_instances, size_t num_threads, uint64_t base_seed,
+                  std::vector<ParallelRunResult> &results,
+                  std::function<void(TB &, size_t)> configure = std::function<void(TB &, size_t)>()) {
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (num_threads > num_instances)
+        num_threads = num_instances;
+
+    results.assign(num_instances, ParallelRunResult());
+    std::atomic<size_t> next_instance(0);
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; t++) {
+        workers.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next_instance.fetch_add(1)) < num_instances)
+                run_parallel_instance(i, base_seed + i, configure, results[i]);
+        }));
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    bool passed = true;
+    for (const ParallelRunResult &result : results)
+        passed = passed && !result.failed;
+    return passed;
+}
+
+// prints the output of every instance in index order, one line per failed
+// instance and a PASSED/FAILED total line
+inline void print_parallel_summary(const std::vector<ParallelRunResult> &results, std::ostream &o) {
+    size_t num_failed = 0;
+    for (const ParallelRunResult &result : results) {
+        o << "INSTANCE " << result.index << " SEED " << result.seed << "\n" << result.output;
+        if (result.failed) {
+            num_failed++;
+            o << "INSTANCE " << result.index << " FAILED FIRST AT CYCLE " << result.first_failed_cycle << "\n";
+        }
+    }
+    o << "RAN " << results.size() << " INSTANCES ";
+    if (num_failed)
+        o << num_failed << " FAILED" << std::endl;
+    else
+        o << "PASSED" << std::endl;
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef PORT_LAYOUT_H
+#define PORT_LAYOUT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// name, width and verilator field of one dut port. The generated testbench
+// lists its ports with these in declaration order, which is also the order of
+// the per cycle records of the stimulus and capture files.
+struct PortDescriptor {
+    std::string name;
+    size_t width;
+    // size of the verilator field, CData/SData/IData/QData or WData words
+    size_t bytes;
+    // the verilator field, NULL for descriptors used only to describe a file
+    void *field;
+    // bits of the most significant word of the field that belong to the
+    // port, verilator expects the bits above them to be clear
+    uint64_t top_mask;
+
+    PortDescriptor(const std::string &_name, size_t _width, void *_field)
+            : name(_name), width(_width), bytes(field_bytes(_width)), field(_field),
+              top_mask(field_top_mask(_width)) {}
+
+    // size of the most significant word of the field, the whole field for
+    // CData to QData and the last 32 bit word for WData
+    size_t top_bytes() const {
+        return bytes <= 8 ? bytes : 4;
+    }
+
+    static size_t field_bytes(size_t width) {
+        if (width <= 8)
+            return 1;
+        else if (width <= 16)
+            return 2;
+        else if (width <= 32)
+            return 4;
+        else if (width <= 64)
+            return 8;
+        return ((width + 31) / 32) * 4;
+    }
+
+    static uint64_t field_top_mask(size_t width) {
+        size_t top_bits = width <= 64 ? width : width - ((width - 1) / 32) * 32;
+        return top_bits >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << top_bits) - 1;
+    }
+};
+
+// sum of the field sizes of ports, i.e. the size of one record
+inline size_t port_record_bytes(const std::vector<PortDescriptor> &ports) {
+    size_t bytes = 0;
+    for (const PortDescriptor &port : ports)
+        bytes += port.bytes;
+    return bytes;
+}
+
+// FNV-1a hash over the names and widths of ports, stored in stimulus and
+// capture files to detect files made for a different port layout
+inline uint64_t port_layout_hash(const std::vector<PortDescriptor> &ports) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const PortDescriptor &port : ports) {
+        for (char c : port.name)
+            hash = (hash ^ (uint8_t) c) * 0x100000001b3ull;
+        hash = (hash ^ 0) * 0x100000001b3ull;
+        for (size_t i = 0; i < 8; i++)
+            hash = (hash ^ (uint8_t) (port.width >> (i * 8))) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() : data(NULL), size(0) {}
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const char *path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void *mapped = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        // records are read front to back
+        madvise(mapped, (size_t) st.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t *) mapped;
+        size = (size_t) st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap((void *) data, size);
+            data = NULL;
+            size = 0;
+        }
+    }
+
+    const uint8_t *get_data() const {
+        return data;
+    }
+
+    size_t get_size() const {
+        return size;
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// advances state by one step of splitmix64 and returns the next output, used
+// to expand a single seed into the state of an Rng
+inline uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** generator, 64 random bits per call with no locking, one per
+// testbench so that instances on different threads do not share state. The
+// same seed always gives the same sequence. Also usable as the generator of
+// the <random> distributions.
+class Rng {
+public:
+    typedef uint64_t result_type;
+
+    explicit Rng(uint64_t _seed = 0) {
+        seed(_seed);
+    }
+
+    void seed(uint64_t _seed) {
+        uint64_t state = _seed;
+        for (size_t i = 0; i < 4; i++)
+            s[i] = splitmix64(state);
+    }
+
+    static constexpr uint64_t min() { return 0; }
+
+    static constexpr uint64_t max() { return ~((uint64_t) 0); }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    uint64_t operator()() {
+        return next();
+    }
+
+    // uniform in [0, bound), bound must not be zero
+    uint64_t below(uint64_t bound) {
+        // Lemire's multiply and reject, unbiased and usually without division
+        __extension__ typedef unsigned __int128 uint128_t;
+        uint128_t product = (uint128_t) next() * bound;
+        uint64_t low = (uint64_t) product;
+        if (low < bound) {
+            uint64_t threshold = -bound % bound;
+            while (low < threshold) {
+                product = (uint128_t) next() * bound;
+                low = (uint64_t) product;
+            }
+        }
+        return (uint64_t) (product >> 64);
+    }
+
+    // uniform in [0, 2^width), width at most 64
+    uint64_t bits(size_t width) {
+        return width >= 64 ? next() : next() >> (64 - width);
+    }
+
+    // fills num_words words with random values
+    void fill(uint64_t *words, size_t num_words) {
+        for (size_t i = 0; i < num_words; i++)
+            words[i] = next();
+    }
+
+    // fills num_bytes bytes of a buffer of any alignment, e.g. the records
+    // of a stimulus file
+    void fill_bytes(void *dst, size_t num_bytes) {
+        uint8_t *bytes = (uint8_t *) dst;
+        for (; num_bytes >= 8; num_bytes -= 8, bytes += 8) {
+            uint64_t word = next();
+            memcpy(bytes, &word, 8);
+        }
+        if (num_bytes) {
+            uint64_t word = next();
+            memcpy(bytes, &word, num_bytes);
+        }
+    }
+
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// lock-free queue of fixed capacity between exactly one producer thread and
+// one consumer thread
+template<class T>
+class SpscRing {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // producer side, returns false if the ring is full
+    bool try_push(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask)
+                return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side, waits for the consumer while the ring is full
+    void push(const T &item) {
+        while (!try_push(item))
+            std::this_thread::yield();
+    }
+
+    // consumer side, returns false if the ring is empty
+    bool try_pop(T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // the consumer and the producer indices are kept on separate cache lines
+    char pad0[64];
+    std::atomic<size_t> head;
+    size_t cached_tail;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    size_t cached_head;
+    char pad2[64];
+};
+
+// a transaction the checker of a scoreboard rejected
+struct ScoreboardFailure {
+    // cycle the transaction was sampled at
+    unsigned long cycle;
+    std::string message;
+};
+
+// type independent part of a Scoreboard, attached to a testbench with
+// Testbench::attach_scoreboard. The testbench calls sample() after every
+// cycle and collects failures with take_failures() on its own thread.
+class ScoreboardBase {
+public:
+    ScoreboardBase() : num_failures(0), num_taken(0) {}
+
+    virtual ~ScoreboardBase() {}
+
+    // starts the checker thread, does nothing if it is running
+    virtual void start() = 0;
+
+    // checks everything sampled so far and stops the checker thread
+    virtual void stop() = 0;
+
+    // starts a new checker thread in a process forked while the checker
+    // thread was running, fork() only copies the calling thread. Everything
+    // sampled must have been checked before the fork, see drain()
+    virtual void restart_after_fork() = 0;
+
+    // called by the testbench after every cycle with the outputs settled
+    virtual void sample(unsigned long cycle) = 0;
+
+    // waits until every sampled transaction has been checked
+    virtual void drain() = 0;
+
+    // true if failures were reported since the last take_failures, cheap
+    // enough to call every cycle
+    bool has_new_failures() const {
+        return num_failures.load(std::memory_order_acquire) != num_taken;
+    }
+
+    // moves the failures reported since the last call to failures, in
+    // cycle order
+    void take_failures(std::vector<ScoreboardFailure> &failures) {
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        failures.insert(failures.end(), pending_failures.begin(), pending_failures.end());
+        pending_failures.clear();
+        num_taken = num_failures.load(std::memory_order_relaxed);
+    }
+
+protected:
+    // called on the checker thread
+    void report_failure(unsigned long cycle, const std::string &message) {
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        ScoreboardFailure failure = {cycle, message};
+        pending_failures.push_back(failure);
+        num_failures.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    std::mutex failures_mutex;
+    std::vector<ScoreboardFailure> pending_failures;
+    std::atomic<size_t> num_failures;
+    // only used by the testbench thread
+    size_t num_taken;
+};
+
+// checks the outputs of the dut against a reference model on a second
+// thread. The monitor runs on the simulation thread after every cycle and
+// returns true if the cycle has a transaction, e.g. because an output is
+// valid, which it writes to txn. Transactions go through a lock-free ring to
+// the checker, which runs on its own thread in sample order and returns false
+// with a message for a wrong transaction. The monitor only copies values, so
+// the simulation overlaps with the reference model and only waits if the
+// checker falls capacity transactions behind.
+template<class Txn>
+class Scoreboard : public ScoreboardBase {
+public:
+    typedef std::function<bool(unsigned long cycle, Txn &txn)> Monitor;
+    typedef std::function<bool(unsigned long cycle, const Txn &txn, std::string &message)> Checker;
+
+    Scoreboard(Monitor _monitor, Checker _checker, size_t capacity = 4096)
+            : monitor(_monitor), checker(_checker), ring(capacity), num_sampled(0), num_checked(0),
+              stopping(false), running(false) {}
+
+    Scoreboard(const Scoreboard &) = delete;
+
+    Scoreboard &operator=(const Scoreboard &) = delete;
+
+    ~Scoreboard() {
+        stop();
+    }
+
+    void start() override {
+        if (running)
+            return;
+        stopping.store(false, std::memory_order_relaxed);
+        checker_thread.reset(new std::thread(&Scoreboard::check_loop, this));
+        running = true;
+    }
+
+    void stop() override {
+        if (!running)
+            return;
+        stopping.store(true, std::memory_order_release);
+        checker_thread->join();
+        checker_thread.reset();
+        running = false;
+    }
+
+    void restart_after_fork() override {
+        if (!running)
+            return;
+        // the handle belongs to a thread of the parent, which can neither be
+        // joined nor destroyed here
+        checker_thread.release();
+        running = false;
+        start();
+    }
+
+    // without a running checker thread the transaction is checked on the
+    // calling thread
+    void sample(unsigned long cycle) override {
+        Entry entry;
+        if (!monitor(cycle, entry.txn))
+            return;
+        entry.cycle = cycle;
+        num_sampled++;
+        if (running)
+            ring.push(entry);
+        else
+            check(entry);
+    }
+
+    void drain() override {
+        while (running && num_checked.load(std::memory_order_acquire) != num_sampled)
+            std::this_thread::yield();
+    }
+
+    // number of transactions sampled so far
+    unsigned long get_num_sampled() const {
+        return num_sampled;
+    }
+
+private:
+    struct Entry {
+        unsigned long cycle;
+        Txn txn;
+    };
+
+    Monitor monitor;
+    Checker checker;
+    SpscRing<Entry> ring;
+    // only used by the simulation thread
+    unsigned long num_sampled;
+    std::atomic<unsigned long> num_checked;
+    std::atomic<bool> stopping;
+    bool running;
+    std::unique_ptr<std::thread> checker_thread;
+
+    void check_loop() {
+        Entry entry;
+        for (;;) {
+            // read before popping, everything pushed before stop() is then
+            // visible to the pop and checked before exiting
+            bool stop_requested = stopping.load(std::memory_order_acquire);
+            if (!ring.try_pop(entry)) {
+                if (stop_requested)
+                    return;
+                std::this_thread::yield();
+                continue;
+            }
+
+            check(entry);
+        }
+    }
+
+    void check(const Entry &entry) {
+        std::string message;
+        if (!checker(entry.cycle, entry.txn, message))
+            report_failure(entry.cycle, message);
+        num_checked.fetch_add(1, std::memory_order_release);
+    }
+};
+
+#endif
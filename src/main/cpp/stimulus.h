@@ -0,0 +1,179 @@
+#ifndef STIMULUS_H
+#define STIMULUS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "port_layout.h"
+
+// binary stimulus file: a StimulusHeader followed by num_records records.
+// Each record holds the value of every input port in generated port order,
+// each value stored exactly like its verilator field (1, 2, 4 or 8 bytes,
+// or the WData words), in host byte order and without padding.
+struct StimulusHeader {
+    char magic[8];
+    uint64_t layout_hash;
+    uint32_t num_ports;
+    uint32_t record_bytes;
+    uint64_t num_records;
+};
+
+static const char stimulus_magic[8] = {'V', 'T', 'E', 'S', 'T', 'I', 'M', '1'};
+
+// memory maps a stimulus file and copies its records straight into the dut
+// input fields
+class StimulusReplay {
+public:
+    StimulusReplay() : records(NULL), record_bytes(0), num_records(0) {}
+
+    // maps the file at path and checks that it was written for ports, on
+    // failure returns false and describes the problem in error
+    bool open(const char *path, const std::vector<PortDescriptor> &ports, std::string &error) {
+        records = NULL;
+        num_records = 0;
+        if (!file.open(path)) {
+            error = "cannot map stimulus file";
+            return false;
+        }
+
+        StimulusHeader header;
+        if (file.get_size() < sizeof(header)) {
+            error = "stimulus file too short";
+            return false;
+        }
+        memcpy(&header, file.get_data(), sizeof(header));
+
+        if (memcmp(header.magic, stimulus_magic, sizeof(stimulus_magic)) != 0) {
+            error = "not a stimulus file";
+            return false;
+        }
+        if (header.layout_hash != port_layout_hash(ports) || header.num_ports != ports.size() ||
+            header.record_bytes != port_record_bytes(ports)) {
+            error = "stimulus file was written for a different input port layout";
+            return false;
+        }
+        if (file.get_size() < sizeof(header) + header.num_records * header.record_bytes) {
+            error = "stimulus file is truncated";
+            return false;
+        }
+
+        fields.clear();
+        for (const PortDescriptor &port : ports) {
+            Field field = {port.field, port.bytes, (uint8_t *) port.field + port.bytes - port.top_bytes(),
+                           port.top_bytes(), port.top_mask};
+            fields.push_back(field);
+        }
+        records = file.get_data() + sizeof(header);
+        record_bytes = header.record_bytes;
+        num_records = header.num_records;
+        return true;
+    }
+
+    size_t get_num_records() const {
+        return num_records;
+    }
+
+    // copies record into the input fields, clearing any bits above the port
+    // widths that a file from another producer may have set
+    void apply(size_t record) const {
+        const uint8_t *src = records + record * record_bytes;
+        for (const Field &field : fields) {
+            memcpy(field.dst, src, field.bytes);
+            mask_top(field);
+            src += field.bytes;
+        }
+    }
+
+private:
+    struct Field {
+        void *dst;
+        size_t bytes;
+        // most significant word of dst, see PortDescriptor::top_mask
+        void *top;
+        size_t top_bytes;
+        uint64_t top_mask;
+    };
+
+    static void mask_top(const Field &field) {
+        switch (field.top_bytes) {
+            case 1:
+                *(uint8_t *) field.top &= (uint8_t) field.top_mask;
+                break;
+            case 2:
+                *(uint16_t *) field.top &= (uint16_t) field.top_mask;
+                break;
+            case 4:
+                *(uint32_t *) field.top &= (uint32_t) field.top_mask;
+                break;
+            default:
+                *(uint64_t *) field.top &= field.top_mask;
+        }
+    }
+
+    MappedFile file;
+    std::vector<Field> fields;
+    const uint8_t *records;
+    size_t record_bytes;
+    size_t num_records;
+};
+
+// writes stimulus files for a port layout, records are given as raw bytes in
+// the layout described by StimulusHeader
+class StimulusWriter {
+public:
+    StimulusWriter() : file(NULL), num_records(0) {}
+
+    StimulusWriter(const StimulusWriter &) = delete;
+
+    StimulusWriter &operator=(const StimulusWriter &) = delete;
+
+    ~StimulusWriter() {
+        close();
+    }
+
+    bool open(const char *path, const std::vector<PortDescriptor> &ports) {
+        close();
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+
+        memcpy(header.magic, stimulus_magic, sizeof(stimulus_magic));
+        header.layout_hash = port_layout_hash(ports);
+        header.num_ports = (uint32_t) ports.size();
+        header.record_bytes = (uint32_t) port_record_bytes(ports);
+        header.num_records = 0;
+        num_records = 0;
+        return fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    bool is_open() const {
+        return file != NULL;
+    }
+
+    bool write_record(const uint8_t *record) {
+        num_records++;
+        return fwrite(record, 1, header.record_bytes, file) == header.record_bytes;
+    }
+
+    // fills in the record count and closes the file
+    bool close() {
+        if (!file)
+            return true;
+
+        header.num_records = num_records;
+        bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+        return ok;
+    }
+
+private:
+    FILE *file;
+    StimulusHeader header;
+    uint64_t num_records;
+};
+
+#endif
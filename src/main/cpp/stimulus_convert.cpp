@@ -0,0 +1,183 @@
+// converts a text stimulus description into the binary stimulus file read by
+// Testbench::replay_stimulus
+//
+// build: c++ -std=c++11 -o stimulus_convert stimulus_convert.cpp
+// usage: stimulus_convert <input csv> <output stimulus file>
+//
+// The first non comment line lists the input ports as name:width in the
+// order of the generated input_ports() method (the generated testbench
+// header contains this line). Every following line is one cycle with one
+// value per port, written as 0x prefixed hexadecimal or as decimal. Lines
+// starting with '#' are ignored.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "stimulus.h"
+
+static std::vector<std::string> split(const std::string &line, char delim) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, delim)) {
+        size_t first = field.find_first_not_of(" \t\r");
+        size_t last = field.find_last_not_of(" \t\r");
+        fields.push_back(first == std::string::npos ? "" : field.substr(first, last - first + 1));
+    }
+    return fields;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// writes the value in text into dst as a little endian number of
+// port.bytes bytes truncated to port.width bits
+static bool parse_value(const std::string &text, const PortDescriptor &port, uint8_t *dst) {
+    std::vector<uint8_t> bytes(port.bytes, 0);
+
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        size_t nibble = 0;
+        for (size_t i = text.size(); i-- > 2; nibble++) {
+            int digit = hex_digit(text[i]);
+            if (digit < 0)
+                return false;
+            if (nibble / 2 < bytes.size())
+                bytes[nibble / 2] |= (uint8_t) (digit << ((nibble % 2) * 4));
+        }
+    } else {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        // bytes = bytes * 10 + digit for every digit, so values of any width
+        // are parsed, carries out of the top byte are dropped like the
+        // excess digits of a hexadecimal value
+        for (char c : text) {
+            unsigned carry = (unsigned) (c - '0');
+            for (size_t i = 0; i < bytes.size(); i++) {
+                carry += bytes[i] * 10u;
+                bytes[i] = (uint8_t) carry;
+                carry >>= 8;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < bytes.size(); i++) {
+        size_t low_bit = i * 8;
+        if (low_bit >= port.width)
+            bytes[i] = 0;
+        else if (port.width - low_bit < 8)
+            bytes[i] &= (uint8_t) ((1 << (port.width - low_bit)) - 1);
+    }
+
+    memcpy(dst, bytes.data(), bytes.size());
+    return true;
+}
+
+// deletes what was written of the output at path, unless it is a device or
+// other special file
+static void remove_output(const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+        remove(path);
+}
+
+// converts the csv at in_path into writer, which it opens at out_path once
+// the port header line is read. Returns false after printing an error.
+static bool convert(std::istream &in, const char *in_path, const char *out_path, StimulusWriter &writer) {
+    std::vector<PortDescriptor> ports;
+    std::vector<uint8_t> record;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        std::vector<std::string> fields = split(line, ',');
+        if (ports.empty()) {
+            for (const std::string &field : fields) {
+                size_t colon = field.rfind(':');
+                // at most 9 digits, so the width neither overflows nor
+                // makes the record size absurd
+                if (colon == std::string::npos || colon + 1 == field.size() || field.size() - colon - 1 > 9 ||
+                    field.find_first_not_of("0123456789", colon + 1) != std::string::npos ||
+                    std::stoul(field.substr(colon + 1)) == 0) {
+                    std::cerr << in_path << ":" << line_number << ": expected name:width, got " << field << std::endl;
+                    return false;
+                }
+                ports.push_back(PortDescriptor(field.substr(0, colon), std::stoul(field.substr(colon + 1)), NULL));
+            }
+            if (!writer.open(out_path, ports)) {
+                std::cerr << "cannot write " << out_path << std::endl;
+                return false;
+            }
+            record.resize(port_record_bytes(ports));
+            continue;
+        }
+
+        if (fields.size() != ports.size()) {
+            std::cerr << in_path << ":" << line_number << ": expected " << ports.size() << " values, got "
+                      << fields.size() << std::endl;
+            return false;
+        }
+
+        uint8_t *dst = record.data();
+        for (size_t i = 0; i < ports.size(); i++) {
+            if (!parse_value(fields[i], ports[i], dst)) {
+                std::cerr << in_path << ":" << line_number << ": bad value " << fields[i] << " for "
+                          << ports[i].name << std::endl;
+                return false;
+            }
+            dst += ports[i].bytes;
+        }
+        if (!writer.write_record(record.data())) {
+            std::cerr << "cannot write " << out_path << std::endl;
+            return false;
+        }
+    }
+
+    if (ports.empty()) {
+        std::cerr << in_path << ": missing port header line" << std::endl;
+        return false;
+    }
+    if (!writer.close()) {
+        std::cerr << "cannot write " << out_path << std::endl;
+        remove_output(out_path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <input csv> <output stimulus file>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    StimulusWriter writer;
+    if (!convert(in, argv[1], argv[2], writer)) {
+        // no partial output file is left behind
+        if (writer.is_open()) {
+            writer.close();
+            remove_output(argv[2]);
+        }
+        return 1;
+    }
+    return 0;
+}
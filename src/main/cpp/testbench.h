@@ -5,16 +5,51 @@
 
 #include "veri_api.h"
 #if VM_TRACE
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+typedef VerilatedFstC VerilatedTraceFile;
+#else
 #include "verilated_vcd_c.h"
+typedef VerilatedVcdC VerilatedTraceFile;
+#endif
 #endif
 #include "veri_aggregate_api.h"
 #include "bits.h"
+#include "testbench_log.h"
+#include "expect_batch.h"
+#include "stimulus.h"
+#include "capture.h"
+#include "flight_recorder.h"
+#include "constrained_random.h"
+#include "scoreboard.h"
+#if VTE_SAVABLE
+#include "checkpoint.h"
+#endif
 #include <iostream>
 #include <verilated.h>
 #include <vector>
 #include <map>
 #include <string>
 #include <list>
+#include <climits>
+#include <functional>
+
+// verilator 4.202 and later give every model its own VerilatedContext,
+// which holds the simulation time and finish flag of that model only
+#if defined(VERILATOR_VERSION_INTEGER) && VERILATOR_VERSION_INTEGER >= 4202000
+#define VTE_CONTEXT_API 1
+#else
+#define VTE_CONTEXT_API 0
+#endif
+
+// threads of the verilated model and of the FST writer, set by the backend
+// from --verilator-threads and --trace-threads
+#ifndef VTE_MODEL_THREADS
+#define VTE_MODEL_THREADS 0
+#endif
+#ifndef VTE_TRACE_THREADS
+#define VTE_TRACE_THREADS 0
+#endif
 
 class VerilatorBundle;
 
@@ -28,23 +63,87 @@ public:
     Module *dut;
     bool failed;
     unsigned long first_failed_cycle;
-    static vluint64_t main_time;
+    // simulation time of this instance in half cycles
+    vluint64_t main_time;
+    // seed of this instance, set by the runner that created it
+    uint64_t seed;
+    // random numbers of this instance, seeded from seed by set_seed so a run
+    // is reproduced by its seed
+    Rng rng;
+#if VTE_CONTEXT_API
+    VerilatedContext *contextp;
+#endif
+
+    // text output level, LOG_FULL reproduces the per operation output
+    LogLevel log_level;
+    // destination of all text output, written out line by line at LOG_FULL
+    // and in large chunks at the quieter levels or after
+    // set_log_buffered(true), flushed by finish()
+    LogSink log;
 
     Testbench() {
+#if VTE_CONTEXT_API
+        contextp = new VerilatedContext;
+        dut = new Module(contextp);
+#else
         dut = new Module;
+#endif
         m_tickcount = 0l;
         failed = false;
         main_time = 0;
+        seed = 0;
+        needs_eval = true;
+        current_time = &main_time;
+        log_level = LOG_FULL;
+        log_buffered = false;
+        log.set_flush_lines(true);
 #if VM_TRACE
         tfp = NULL;
 #endif
+        trace_all();
     }
 
     virtual ~Testbench() {
         delete dut;
         dut = NULL;
+#if VTE_CONTEXT_API
+        delete contextp;
+        contextp = NULL;
+#endif
+        if (current_time == &main_time)
+            current_time = NULL;
+    }
+
+    // time for sc_time_stamp(), i.e. the time of the testbench most
+    // recently constructed or run on the calling thread
+    static vluint64_t time_stamp() {
+        return current_time ? *current_time : 0;
+    }
+
+    virtual void set_seed(uint64_t _seed) {
+        seed = _seed;
+        rng.seed(_seed);
+    }
+
+    void set_log_level(LogLevel level) {
+        log_level = level;
+        log.set_flush_lines(log_level >= LOG_FULL && !log_buffered);
+    }
+
+    // true keeps the LOG_FULL output in large chunks as well, which is
+    // faster but loses the lines before a crash or abort and no longer
+    // interleaves in order with other writes to the same stream
+    void set_log_buffered(bool buffered) {
+        log_buffered = buffered;
+        log.set_flush_lines(log_level >= LOG_FULL && !log_buffered);
     }
 
+    // records every poke, step and expect to a binary file at path in
+    // addition to the text output, see print_event_log for reading it back
+    bool open_event_log(const char *path) { return event_log.open(path); }
+
+    void close_event_log() { event_log.close(); }
+
     // sets reset to 1 for num_cycles cycles
     virtual void reset(int num_cycles) {
         for (int i = 0; i < num_cycles; i++) {
@@ -53,14 +152,49 @@ public:
 
         }
         dut->reset = 0;
+        needs_eval = true;
     }
 #if VM_TRACE
-    void init_dump(VerilatedVcdC* _tfp) { tfp = _tfp; }
+    void init_dump(VerilatedTraceFile* _tfp) { tfp = _tfp; }
 #endif
 
 #if VM_TRACE
-    VerilatedVcdC* tfp;
+    VerilatedTraceFile* tfp;
 #endif
+
+    // only dumps cycles start_cycle up to but excluding stop_cycle to the
+    // trace file, the calls below replace each other. They have no effect if
+    // the model is built without tracing.
+    void trace_window(unsigned long start_cycle, unsigned long stop_cycle) {
+        trace_start = start_cycle;
+        trace_stop = stop_cycle;
+        trace_failure_cycles = 0;
+        trace_trigger = std::function<bool()>();
+    }
+
+    // dumps every cycle, the default
+    void trace_all() {
+        trace_window(0, ULONG_MAX);
+    }
+
+    // dumps nothing until the first failure is recorded, then num_cycles
+    // cycles starting at the cycle it is recorded in. The trace shows nothing
+    // before that, enable_flight_recorder keeps the cycles leading up to it.
+    // A scoreboard failure is recorded after the cycle it was sampled at, see
+    // attach_scoreboard, so the window can start after the failing cycle
+    void trace_after_failure(unsigned long num_cycles) {
+        trace_window(ULONG_MAX, ULONG_MAX);
+        trace_failure_cycles = num_cycles;
+    }
+
+    // dumps nothing until trigger() returns true before a cycle, then
+    // num_cycles cycles starting with that one. trigger is only called while
+    // a trace file is attached.
+    void trace_when(std::function<bool()> trigger, unsigned long num_cycles) {
+        trace_window(ULONG_MAX, ULONG_MAX);
+        trace_trigger = trigger;
+        trace_trigger_cycles = num_cycles;
+    }
     // pokes each vec element with is corresponding element in values
     // i.e. poke(vec[i], values[i]) for i = 0 until length of vec
     template<class Data>
@@ -74,82 +208,249 @@ public:
     // use '.' to access fields of nested bundle elements
     void poke(VerilatorBundle &bundle, std::map<std::string, Bits> &values);
 
+    // pokes each wire in handles with its corresponding element in values,
+    // handles come from VerilatorBundle::resolve
+    void poke(std::vector<VerilatorHandle> &handles, std::vector<Bits> &values) {
+        for (size_t i = 0; i < handles.size(); i++)
+            poke(*handles[i], values[i]);
+    }
+
     // puts the value contained in bits into wire, will zero-extend or truncate
     // bits in order to fit the width of wire.
-    // also prints "  POKE $wire_name <- $poke_value"
+    // also prints "  POKE $wire_name <- $poke_value" at LOG_FULL
     void poke(VerilatorDataWrapper &wire, Bits bits) {
         //assert(wire.get_width() == bits.get_width());
         bits.set_width(wire.get_width());
 
-        std::cout << "  POKE " << wire.get_name() << " <- " << bits << std::endl;
+        if (log_level >= LOG_FULL)
+            log << "  POKE " << wire.get_name() << " <- " << bits << "\n";
+        if (event_log.is_open())
+            event_log.poke(m_tickcount, wire, bits);
         wire.put_value(bits);
+        needs_eval = true;
     }
 
     // returns a Bits instance containing the value of wire
     Bits peek(VerilatorDataWrapper &wire) {
-        dut->eval();
+        eval_if_needed();
         return wire.get_value();
     }
 
+    // writes value into port without building a Bits instance and without
+    // printing, bits above the port width are dropped
+    template<class T, size_t W>
+    void poke(VerilatorPort<T, W> &port, uint64_t value) {
+        port.set((T) value);
+        needs_eval = true;
+    }
+
+    // returns the value of port as a native integer
+    template<class T, size_t W>
+    T peek(VerilatorPort<T, W> &port) {
+        eval_if_needed();
+        return port.get();
+    }
+
+    // writes bits into a wide port without building a Bits instance and
+    // without printing
+    template<size_t W>
+    void poke(VerilatorWidePort<W> &port, const FixedBits<W> &bits) {
+        port.set_bits(bits);
+        needs_eval = true;
+    }
+
+    // returns the value of a wide port as a FixedBits<W>
+    template<size_t W>
+    FixedBits<W> peek(VerilatorWidePort<W> &port) {
+        eval_if_needed();
+        return port.get_bits();
+    }
+
     std::map<std::string, Bits> peek(VerilatorBundle &bundle);
 
     template<class Data>
     std::vector<Bits> peek(VerilatorVec<Data> &vec);
 
     // toggles the clock num_steps times,
-    // prints "STEP $current_cycle_count -> $new_cycle_count"
+    // prints "STEP $current_cycle_count -> $new_cycle_count" at LOG_FULL
     virtual void step(int num_steps) {
         // Increment our own internal time reference
-        std::cout << "STEP " << m_tickcount << " -> ";
+        if (log_level >= LOG_FULL)
+            log << "STEP " << m_tickcount << " -> " << (m_tickcount + num_steps) << "\n";
+        if (event_log.is_open())
+            event_log.step(m_tickcount, m_tickcount + num_steps);
+        unsigned long first_cycle = m_tickcount;
         m_tickcount += num_steps;
-        std::cout << m_tickcount << std::endl;
 
         for (int i = 0; i < num_steps; i++) {
+#if VM_TRACE
+            bool dump = tfp && trace_cycle(first_cycle + i);
+#endif
             // Make sure any combinatorial logic depending upon
             // inputs that may have changed before we called tick()
             // has settled before the rising edge of the clock.
             dut->clock = 0;
             dut->eval();
 #if VM_TRACE
-            if (tfp) tfp->dump(main_time);
+            if (dump) tfp->dump(main_time);
 #endif
             // Toggle the clock
-            main_time += 1;
+            advance_time();
             // Rising edge
             dut->clock = 1;
             dut->eval();
 #if VM_TRACE
-            if (tfp) tfp->dump(main_time);
+            if (dump) tfp->dump(main_time);
 #endif  
-            main_time += 1;
+            advance_time();
+            if (capture.is_open())
+                capture.sample();
+            observe_cycle(first_cycle + i + 1);
         }
+        // the rising edge eval leaves the model settled, step(0) evaluates
+        // nothing and leaves pokes pending
+        if (num_steps > 0)
+            needs_eval = false;
+        if (!scoreboards.empty())
+            collect_scoreboard_failures();
+    }
+
+    // stop condition of run_cycles that never ends the loop early
+    struct NeverStop {
+        bool operator()() const { return false; }
+    };
+
+    // toggles the clock num_cycles times like step(), but without printing,
+    // event logging, tracing or output capture, so the loop is as tight as a
+    // hand written verilator main loop. Attached scoreboards and the flight
+    // recorder still sample every cycle. returns the number of cycles run
+    unsigned long run_cycles(unsigned long num_cycles) {
+        return run_cycles(num_cycles, NeverStop());
+    }
+
+    // same as run_cycles(num_cycles), but stop() is called after every cycle
+    // and the loop ends after the first cycle for which it returns true, e.g.
+    //     run_cycles(1000000, [&]() { return ports.io_done.get() != 0; });
+    template<class StopCondition>
+    unsigned long run_cycles(unsigned long num_cycles, StopCondition stop) {
+        Module *model = dut;
+        unsigned long first_cycle = m_tickcount;
+        bool observed = recorder.is_open() || !scoreboards.empty();
+        unsigned long cycle = 0;
+        while (cycle < num_cycles) {
+            model->clock = 0;
+            model->eval();
+            advance_time();
+            model->clock = 1;
+            model->eval();
+            advance_time();
+            cycle++;
+            if (observed)
+                observe_cycle(first_cycle + cycle);
+            if (stop())
+                break;
+        }
+
+        m_tickcount += cycle;
+        if (cycle > 0)
+            needs_eval = false;
+        if (!scoreboards.empty())
+            collect_scoreboard_failures();
+        return cycle;
+    }
+
+    // evaluates the dut, call this after changing dut inputs directly instead
+    // of through poke so that following peeks and expects see the change
+    void settle() {
+        dut->eval();
+        needs_eval = false;
     }
 
     // first truncates or zero-extends expected_value to match the width of
     // wire, then checks if wire contains the same value as expected_value,
+    // prints the result at LOG_FULL, or at LOG_FAILURES and up if it failed
     void expect(VerilatorDataWrapper &wire, Bits expected_value) {
-        dut->eval();
+        eval_if_needed();
         expected_value.set_width(wire.get_width());
-        std::cout << "EXPECT AT " << m_tickcount << "\t" << wire.get_name();
 
         Bits actual_value = wire.get_value();
-        std::cout << " got " << actual_value << " expected " << expected_value;
-
-        if (actual_value == expected_value) {
-            std::cout << " PASS" << std::endl;
-        } else {
-            std::cout << " FAIL" << std::endl;
-            if (!failed) {
-                failed = true;
-                first_failed_cycle = m_tickcount;
+        bool passed = actual_value == expected_value;
+
+        if (log_level >= LOG_FULL || (!passed && log_level >= LOG_FAILURES))
+            log << "EXPECT AT " << m_tickcount << "\t" << wire.get_name() << " got " << actual_value
+                << " expected " << expected_value << (passed ? " PASS\n" : " FAIL\n");
+        if (event_log.is_open())
+            event_log.expect(m_tickcount, wire, actual_value, expected_value, passed);
+
+        if (!passed)
+            mark_failed();
+    }
+
+    // registers a check of wire against expected_value that is done by the
+    // next commit_expects(), width handling is the same as expect()
+    void expect_later(VerilatorDataWrapper &wire, const Bits &expected_value) {
+        expect_batch.add(wire, expected_value, NULL);
+    }
+
+    // same as expect_later(wire, expected_value) but only compares the bits
+    // that are set in mask
+    void expect_later(VerilatorDataWrapper &wire, const Bits &expected_value, const Bits &mask) {
+        expect_batch.add(wire, expected_value, &mask);
+    }
+
+    // evaluates the dut if inputs changed and checks everything registered with
+    // expect_later since the last commit. Each check is printed and written to
+    // the event log like an expect() of the same wire, masked checks also
+    // print their mask. The comparison is one pass over all checks, at the
+    // quieter levels without an event log only failing checks are then looked
+    // at one by one. returns true if all checks passed
+    bool commit_expects() {
+        if (expect_batch.empty())
+            return true;
+
+        eval_if_needed();
+        expect_batch.sample();
+        bool passed = !expect_batch.any_mismatch();
+
+        bool report_all = log_level >= LOG_FULL || event_log.is_open();
+        if (!passed || report_all) {
+            for (size_t c = 0; c < expect_batch.size(); c++) {
+                bool check_passed = !expect_batch.mismatch(c);
+                if (check_passed && !report_all)
+                    continue;
+
+                VerilatorDataWrapper &wire = expect_batch.get_wire(c);
+                Bits actual_value = expect_batch.get_actual(c);
+                Bits expected_value = expect_batch.get_expected(c);
+                if (log_level >= LOG_FULL || (!check_passed && log_level >= LOG_FAILURES)) {
+                    log << "EXPECT AT " << m_tickcount << "\t" << wire.get_name() << " got " << actual_value
+                        << " expected " << expected_value;
+                    if (expect_batch.is_masked(c))
+                        log << " mask " << expect_batch.get_mask(c);
+                    log << (check_passed ? " PASS\n" : " FAIL\n");
+                }
+                if (event_log.is_open())
+                    event_log.expect(m_tickcount, wire, actual_value, expected_value, check_passed);
             }
         }
+        if (!passed)
+            mark_failed();
+
+        expect_batch.clear();
+        return passed;
     }
 
     // calls expect on each value and the bundle element that corresponds to
     // its key.
     void expect(VerilatorBundle &bundle, std::map<std::string, Bits> &values);
 
+    // calls expect on each wire in handles and its corresponding element in
+    // values, handles come from VerilatorBundle::resolve
+    void expect(std::vector<VerilatorHandle> &handles, std::vector<Bits> &values) {
+        for (size_t i = 0; i < handles.size(); i++)
+            expect(*handles[i], values[i]);
+    }
+
     // calls expect on each vector element and its coresponding value in values
     template<class Data>
     void expect(VerilatorVec<Data> &vec, std::vector<Bits> &values) {
@@ -157,25 +458,361 @@ public:
             expect(vec[i], values[i]);
     }
 
+    // appends the input ports of the dut in generated order, overridden by
+    // the generated testbench
+    virtual void input_ports(std::vector<PortDescriptor> &port_list) {}
+
+    // drives the input ports from the records of the stimulus file at path,
+    // stepping one cycle after each record. Records are copied from the
+    // mapped file straight into the dut fields. Returns false without
+    // stepping if the file cannot be used with this dut.
+    bool replay_stimulus(const char *path) {
+        std::vector<PortDescriptor> port_list;
+        input_ports(port_list);
+
+        StimulusReplay replay;
+        std::string error;
+        if (!replay.open(path, port_list, error)) {
+            if (log_level >= LOG_FAILURES)
+                log << "REPLAY " << path << ": " << error << "\n";
+            return false;
+        }
+
+        for (size_t record = 0; record < replay.get_num_records(); record++) {
+            replay.apply(record);
+            step(1);
+        }
+        return true;
+    }
+
+    // adds a random field for every input port of the dut in generated
+    // order, overridden by the generated testbench
+    virtual void random_input_fields(ConstrainedRandom &random) {}
+
+    // constrained random stimulus over all input ports, each field is
+    // uniformly random over the width of its port until it is constrained.
+    // Constrain the fields once, then call poke_random() every cycle
+    ConstrainedRandom &get_random_inputs() {
+        if (random_inputs.empty())
+            random_input_fields(random_inputs);
+        return random_inputs;
+    }
+
+    // writes new values from rng into the enabled fields of
+    // get_random_inputs(), without printing and without building Bits. The
+    // values are reproduced by the seed of this instance
+    void poke_random() {
+        get_random_inputs().randomize(rng);
+        needs_eval = true;
+    }
+
+    // appends the output ports of the dut in generated order, overridden by
+    // the generated testbench
+    virtual void output_ports(std::vector<PortDescriptor> &port_list) {}
+
+    // records all output ports at the end of every following cycle to a
+    // capture file at path, delta encoded unless delta is false. Compare
+    // two captures with compare_captures or the capture_diff tool.
+    bool start_capture(const char *path, bool delta = true) {
+        std::vector<PortDescriptor> port_list;
+        output_ports(port_list);
+        return capture.open(path, port_list, delta, m_tickcount + 1);
+    }
+
+    bool stop_capture() {
+        return capture.close();
+    }
+
+    // true if the model and the open trace file do all their work on the
+    // calling thread. fork() only copies that thread, see run_forked
+    bool single_threaded() const {
+#if VM_TRACE
+        if (VTE_TRACE_THREADS > 0 && tfp)
+            return false;
+#endif
+        return VTE_MODEL_THREADS <= 1;
+    }
+
+    // stops writing the trace, event log and capture files without touching
+    // them, called in a process forked from the one that opened them so that
+    // only the parent writes them. See run_forked. The flight recorder stays
+    // armed but dumps to the log instead of the shared VCD path, so failing
+    // children do not overwrite each other's dumps
+    void detach_outputs() {
+#if VM_TRACE
+        tfp = NULL;
+#endif
+        event_log.close();
+        capture.detach();
+        recorder_path.clear();
+    }
+
+    // keeps the values of all ports at the end of the last depth cycles and
+    // writes them out when the first failure is recorded, as a VCD file at
+    // vcd_path or as a table to the log at LOG_FAILURES and up if vcd_path is
+    // NULL. To include the failing cycle of a scoreboard, depth must also
+    // cover the delay until its failure is recorded, see attach_scoreboard
+    void enable_flight_recorder(size_t depth, const char *vcd_path = NULL) {
+        std::vector<PortDescriptor> port_list;
+        input_ports(port_list);
+        output_ports(port_list);
+        recorder.open(port_list, depth);
+        recorder_path = vcd_path ? vcd_path : "";
+    }
+
+    void disable_flight_recorder() {
+        recorder.close();
+    }
+
+#if VTE_SAVABLE
+    // saves the state of the model together with the cycle count, failure
+    // state and time of the testbench to a file at path. Needs a model
+    // verilated with --savable, see TesterOptions.savable
+    bool checkpoint(const char *path) {
+        VerilatedSave os;
+        os.open(path);
+        if (!os.isOpen())
+            return false;
+        save_state(os);
+        os.close();
+        return true;
+    }
+
+    // continues from a state saved by checkpoint(path) of the same model
+    bool restore(const char *path) {
+        VerilatedRestore is;
+        is.open(path);
+        if (!is.isOpen())
+            return false;
+        restore_state(is);
+        is.close();
+        return true;
+    }
+
+    // same as checkpoint(path) but keeps the state in memory, so that many
+    // tests can start from one warmed up state without touching the disk
+    void checkpoint(Checkpoint &state) {
+        CheckpointSave os(state);
+        save_state(os);
+        os.close();
+    }
+
+    void restore(const Checkpoint &state) {
+        CheckpointRestore is(state);
+        restore_state(is);
+        is.close();
+    }
+#endif
+
     virtual bool done() {
+#if VTE_CONTEXT_API
+        return contextp->gotFinish();
+#else
         return (Verilated::gotFinish());
+#endif
     }
 
+    // samples scoreboard after every following step() or run_cycles() cycle
+    // and starts its checker thread, see Scoreboard. Its failures are merged
+    // into failed and first_failed_cycle with the cycle the transaction was
+    // sampled at, as soon as a later step() or run_cycles() sees them. That
+    // is at the end of the call that sampled the failing transaction or, if
+    // the checker thread lags, of a later one. drain_scoreboards() bounds the
+    // delay. The children of run_forked keep checking with a checker thread
+    // of their own
+    void attach_scoreboard(ScoreboardBase &scoreboard) {
+        scoreboard.start();
+        scoreboards.push_back(&scoreboard);
+    }
+
+    // waits until the attached scoreboards have checked everything sampled
+    // so far and merges their failures, returns false if this instance has
+    // failed
+    bool drain_scoreboards() {
+        for (ScoreboardBase *scoreboard : scoreboards)
+            scoreboard->drain();
+        collect_scoreboard_failures();
+        return !failed;
+    }
+
+    // starts new checker threads for the attached scoreboards in a process
+    // forked from this one after drain_scoreboards(), see run_forked
+    void restart_scoreboards_after_fork() {
+        for (ScoreboardBase *scoreboard : scoreboards)
+            scoreboard->restart_after_fork();
+    }
+
+    // drains and stops the checker threads of all attached scoreboards
+    void detach_scoreboards() {
+        drain_scoreboards();
+        for (ScoreboardBase *scoreboard : scoreboards)
+            scoreboard->stop();
+        scoreboards.clear();
+    }
+
+    // prints the summary at LOG_SUMMARY and up and flushes all output
     virtual void finish() {
-        std::cout << "RAN " << m_tickcount << " CYCLES ";
-        if (failed)
-            std::cout << "FAILED FIRST AT CYCLE " << first_failed_cycle << std::endl;
-        else
-            std::cout << "PASSED" << std::endl;
+        detach_scoreboards();
+        if (log_level >= LOG_SUMMARY) {
+            log << "RAN " << m_tickcount << " CYCLES ";
+            if (failed)
+                log << "FAILED FIRST AT CYCLE " << first_failed_cycle << "\n";
+            else
+                log << "PASSED\n";
+        }
+        log.flush();
+        event_log.close();
+        capture.close();
     }
 
     // actual implementation of testbench containing all peeks/pokes/expects
     virtual void run() = 0;
+
+    // makes this instance the one sc_time_stamp() reports on the calling
+    // thread and calls run()
+    void run_on_this_thread() {
+        current_time = &main_time;
+        run();
+    }
+
+protected:
+    bool log_buffered;
+    EventLog event_log;
+    ExpectBatch expect_batch;
+    OutputCapture capture;
+    FlightRecorder recorder;
+    std::string recorder_path;
+    ConstrainedRandom random_inputs;
+    std::vector<ScoreboardBase *> scoreboards;
+    std::vector<ScoreboardFailure> scoreboard_failures;
+
+    // set by pokes, cleared by every eval, peeks and expects only evaluate
+    // the dut if inputs changed since the last eval
+    bool needs_eval;
+
+    void eval_if_needed() {
+        if (needs_eval)
+            settle();
+    }
+
+    static thread_local vluint64_t *current_time;
+
+    void advance_time() {
+        main_time += 1;
+#if VTE_CONTEXT_API
+        contextp->time(main_time);
+#endif
+    }
+
+    // records a failure in the current cycle
+    void mark_failed() {
+        mark_failed(m_tickcount);
+    }
+
+    // records a failure in cycle, which may be earlier than the current one
+    // for failures found by a scoreboard. first_failed_cycle keeps the
+    // earliest, the trace window and flight recorder start at the first
+    // failure recorded
+    void mark_failed(unsigned long cycle) {
+        if (failed) {
+            if (cycle < first_failed_cycle)
+                first_failed_cycle = cycle;
+            return;
+        }
+
+        failed = true;
+        first_failed_cycle = cycle;
+        if (trace_failure_cycles)
+            trace_window(m_tickcount, m_tickcount + trace_failure_cycles);
+        if (recorder.is_open())
+            dump_flight_recorder();
+    }
+
+    // feeds the settled outputs at the end of cycle to the flight recorder
+    // and the scoreboards
+    void observe_cycle(unsigned long cycle) {
+        if (recorder.is_open())
+            recorder.sample(cycle);
+        for (ScoreboardBase *scoreboard : scoreboards)
+            scoreboard->sample(cycle);
+    }
+
+    // logs the failures the scoreboards reported since the last call and
+    // marks their cycles failed
+    void collect_scoreboard_failures() {
+        for (ScoreboardBase *scoreboard : scoreboards) {
+            if (!scoreboard->has_new_failures())
+                continue;
+            scoreboard_failures.clear();
+            scoreboard->take_failures(scoreboard_failures);
+            for (const ScoreboardFailure &failure : scoreboard_failures) {
+                if (log_level >= LOG_FAILURES)
+                    log << "SCOREBOARD AT " << failure.cycle << "\t" << failure.message << " FAIL\n";
+                mark_failed(failure.cycle);
+            }
+        }
+    }
+
+#if VTE_SAVABLE
+    // writes the model and the testbench state, override both to add the
+    // state of a derived testbench
+    virtual void save_state(VerilatedSerialize &os) {
+        os << *dut;
+        os.write(&m_tickcount, sizeof(m_tickcount));
+        os.write(&failed, sizeof(failed));
+        os.write(&first_failed_cycle, sizeof(first_failed_cycle));
+        os.write(&main_time, sizeof(main_time));
+        os.write(&seed, sizeof(seed));
+        os.write(&rng, sizeof(rng));
+    }
+
+    virtual void restore_state(VerilatedDeserialize &is) {
+        is >> *dut;
+        is.read(&m_tickcount, sizeof(m_tickcount));
+        is.read(&failed, sizeof(failed));
+        is.read(&first_failed_cycle, sizeof(first_failed_cycle));
+        is.read(&main_time, sizeof(main_time));
+        is.read(&seed, sizeof(seed));
+        is.read(&rng, sizeof(rng));
+#if VTE_CONTEXT_API
+        contextp->time(main_time);
+#endif
+        needs_eval = true;
+    }
+#endif
+
+    void dump_flight_recorder() {
+        if (!recorder_path.empty()) {
+            if (!recorder.dump_vcd(recorder_path.c_str(), "TOP") && log_level >= LOG_FAILURES)
+                log << "FLIGHT RECORDER: cannot write " << recorder_path << "\n";
+        } else if (log_level >= LOG_FAILURES) {
+            log << "FLIGHT RECORDER BEFORE FAILURE AT " << m_tickcount << "\n";
+            recorder.dump_table(log);
+        }
+    }
+
+    // cycles dumped to the trace file, see trace_window
+    unsigned long trace_start;
+    unsigned long trace_stop;
+    // length of the window opened by the first failure, 0 if not armed
+    unsigned long trace_failure_cycles;
+    // opens a window of trace_trigger_cycles cycles when it returns true
+    std::function<bool()> trace_trigger;
+    unsigned long trace_trigger_cycles;
+
+    // true if cycle is inside the trace window, fires an armed trigger
+    bool trace_cycle(unsigned long cycle) {
+        if (trace_trigger && trace_trigger()) {
+            unsigned long num_cycles = trace_trigger_cycles;
+            trace_window(cycle, cycle + num_cycles);
+        }
+        return cycle >= trace_start && cycle < trace_stop;
+    }
 };
 
 // used by double sc_time_stamp() function that is required by verilator
-// main_time is equal to the cycle count
+// before the context API, points at main_time of one instance per thread
 template<class Module>
-vluint64_t Testbench<Module>::main_time = 0;
+thread_local vluint64_t *Testbench<Module>::current_time = NULL;
 
 #endif
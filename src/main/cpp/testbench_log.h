@@ -0,0 +1,324 @@
+#ifndef TESTBENCH_LOG_H
+#define TESTBENCH_LOG_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+#include "bits.h"
+
+// how much text output Testbench produces, each level includes the ones
+// below it
+enum LogLevel {
+    LOG_SILENT = 0,   // nothing
+    LOG_FAILURES = 1, // failing expects
+    LOG_SUMMARY = 2,  // failing expects and the RAN ... summary from finish()
+    LOG_FULL = 3      // every poke, step and expect
+};
+
+// collects formatted text in memory and writes it to an ostream, either
+// after every complete line or in large chunks instead of flushing on every
+// line. Chunks are faster but lose the last lines if the process dies before
+// the next flush.
+class LogSink {
+public:
+    explicit LogSink(std::ostream &_out = std::cout, size_t _capacity = 1 << 16, bool _flush_lines = false)
+            : out(&_out), capacity(_capacity), flush_lines(_flush_lines) {
+        buffer.reserve(capacity);
+    }
+
+    LogSink(const LogSink &) = delete;
+
+    LogSink &operator=(const LogSink &) = delete;
+
+    ~LogSink() {
+        flush();
+    }
+
+    void set_stream(std::ostream &_out) {
+        flush();
+        out = &_out;
+    }
+
+    // true writes out every complete line right away
+    void set_flush_lines(bool _flush_lines) {
+        flush_lines = _flush_lines;
+        if (flush_lines)
+            flush();
+    }
+
+    bool get_flush_lines() const {
+        return flush_lines;
+    }
+
+    void flush() {
+        if (!buffer.empty()) {
+            out->write(buffer.data(), buffer.size());
+            out->flush();
+            buffer.clear();
+        }
+    }
+
+    LogSink &operator<<(const char *text) {
+        buffer.append(text);
+        check_capacity();
+        return *this;
+    }
+
+    LogSink &operator<<(const std::string &text) {
+        buffer.append(text);
+        check_capacity();
+        return *this;
+    }
+
+    LogSink &operator<<(unsigned long value) {
+        char digits[24];
+        size_t len = 0;
+        do {
+            digits[len++] = (char) ('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (len > 0)
+            buffer.push_back(digits[--len]);
+        check_capacity();
+        return *this;
+    }
+
+    // same text as Bits::print without touching any stream format state
+    LogSink &operator<<(const Bits &bits) {
+        size_t num_words = (bits.get_width() + 63) / 64;
+        buffer.append("0x");
+        for (size_t i = num_words; i-- > 1;) {
+            append_hex(bits.get_word(i));
+            buffer.push_back(' ');
+        }
+        append_hex(num_words > 0 ? bits.get_word(0) : 0);
+        check_capacity();
+        return *this;
+    }
+
+private:
+    std::ostream *out;
+    std::string buffer;
+    size_t capacity;
+    bool flush_lines;
+
+    void append_hex(uint64_t word) {
+        static const char hex_digits[] = "0123456789abcdef";
+        char digits[16];
+        size_t len = 0;
+        do {
+            digits[len++] = hex_digits[word & 0xf];
+            word >>= 4;
+        } while (word != 0);
+        while (len > 0)
+            buffer.push_back(digits[--len]);
+    }
+
+    void check_capacity() {
+        if (buffer.size() >= capacity || (flush_lines && !buffer.empty() && buffer.back() == '\n'))
+            flush();
+    }
+};
+
+// kinds of records in a binary event log
+enum LogEventType {
+    EVENT_NAME = 0,        // assigns a wire id to a wire name
+    EVENT_POKE = 1,
+    EVENT_STEP = 2,
+    EVENT_EXPECT_PASS = 3,
+    EVENT_EXPECT_FAIL = 4
+};
+
+static const char event_log_magic[8] = {'V', 'T', 'E', 'L', 'O', 'G', '0', '1'};
+
+// compact binary record of pokes, steps and expects, written in host byte
+// order. Wire names are written once and referred to by id afterwards.
+// print_event_log turns a log back into the text Testbench prints at
+// LOG_FULL.
+//
+// record layout, after the 8 byte magic:
+//   u8 type
+//   EVENT_NAME:   u32 id, u16 length, name
+//   EVENT_POKE:   u64 cycle, u32 id, u32 width, value words
+//   EVENT_STEP:   u64 from cycle, u64 to cycle
+//   EVENT_EXPECT: u64 cycle, u32 id, u32 width, actual words, expected words
+class EventLog {
+public:
+    EventLog() : file(NULL) {}
+
+    EventLog(const EventLog &) = delete;
+
+    EventLog &operator=(const EventLog &) = delete;
+
+    ~EventLog() {
+        close();
+    }
+
+    bool open(const char *path) {
+        close();
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        setvbuf(file, NULL, _IOFBF, 1 << 20);
+        fwrite(event_log_magic, 1, sizeof(event_log_magic), file);
+        wire_ids.clear();
+        return true;
+    }
+
+    void close() {
+        if (file) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    bool is_open() const {
+        return file != NULL;
+    }
+
+    template<class Wire>
+    void poke(unsigned long cycle, Wire &wire, const Bits &value) {
+        uint32_t id = get_wire_id(wire);
+        put_u8(EVENT_POKE);
+        put_u64(cycle);
+        put_u32(id);
+        put_bits(value);
+    }
+
+    void step(unsigned long from_cycle, unsigned long to_cycle) {
+        put_u8(EVENT_STEP);
+        put_u64(from_cycle);
+        put_u64(to_cycle);
+    }
+
+    template<class Wire>
+    void expect(unsigned long cycle, Wire &wire, const Bits &actual, const Bits &expected, bool passed) {
+        uint32_t id = get_wire_id(wire);
+        put_u8(passed ? EVENT_EXPECT_PASS : EVENT_EXPECT_FAIL);
+        put_u64(cycle);
+        put_u32(id);
+        put_bits(actual);
+        for (size_t i = 0; i < (actual.get_width() + 63) / 64; i++)
+            put_u64(i < (expected.get_width() + 63) / 64 ? expected.get_word(i) : 0);
+    }
+
+private:
+    FILE *file;
+    std::unordered_map<const void *, uint32_t> wire_ids;
+
+    template<class Wire>
+    uint32_t get_wire_id(Wire &wire) {
+        std::unordered_map<const void *, uint32_t>::iterator it = wire_ids.find(&wire);
+        if (it != wire_ids.end())
+            return it->second;
+
+        uint32_t id = (uint32_t) wire_ids.size();
+        wire_ids[&wire] = id;
+
+        std::string name = wire.get_name();
+        put_u8(EVENT_NAME);
+        put_u32(id);
+        put_u16((uint16_t) name.size());
+        fwrite(name.data(), 1, name.size(), file);
+        return id;
+    }
+
+    void put_bits(const Bits &value) {
+        put_u32((uint32_t) value.get_width());
+        for (size_t i = 0; i < (value.get_width() + 63) / 64; i++)
+            put_u64(value.get_word(i));
+    }
+
+    void put_u8(uint8_t value) { fwrite(&value, sizeof(value), 1, file); }
+
+    void put_u16(uint16_t value) { fwrite(&value, sizeof(value), 1, file); }
+
+    void put_u32(uint32_t value) { fwrite(&value, sizeof(value), 1, file); }
+
+    void put_u64(uint64_t value) { fwrite(&value, sizeof(value), 1, file); }
+};
+
+// writes the events in the log at path to o in the same text format that
+// Testbench prints at LOG_FULL, returns false if the file is missing or
+// malformed
+inline bool print_event_log(const char *path, std::ostream &o) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char magic[sizeof(event_log_magic)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, event_log_magic, sizeof(magic)) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    std::vector<std::string> names;
+    LogSink sink(o);
+    bool ok = true;
+    uint8_t type;
+    while (ok && fread(&type, sizeof(type), 1, file) == 1) {
+        uint64_t cycle = 0, to_cycle = 0;
+        uint32_t id = 0, width = 0;
+        uint16_t length = 0;
+        switch (type) {
+            case EVENT_NAME: {
+                ok = fread(&id, sizeof(id), 1, file) == 1 && fread(&length, sizeof(length), 1, file) == 1;
+                std::string name(length, '\0');
+                ok = ok && (length == 0 || fread(&name[0], 1, length, file) == length);
+                if (ok) {
+                    if (names.size() <= id)
+                        names.resize(id + 1);
+                    names[id] = name;
+                }
+                break;
+            }
+            case EVENT_STEP:
+                ok = fread(&cycle, sizeof(cycle), 1, file) == 1 && fread(&to_cycle, sizeof(to_cycle), 1, file) == 1;
+                if (ok)
+                    sink << "STEP " << (unsigned long) cycle << " -> " << (unsigned long) to_cycle << "\n";
+                break;
+            case EVENT_POKE:
+            case EVENT_EXPECT_PASS:
+            case EVENT_EXPECT_FAIL: {
+                ok = fread(&cycle, sizeof(cycle), 1, file) == 1 && fread(&id, sizeof(id), 1, file) == 1 &&
+                     fread(&width, sizeof(width), 1, file) == 1 && id < names.size() && width > 0;
+                if (!ok)
+                    break;
+
+                size_t num_words = (width + 63) / 64;
+                std::vector<uint64_t> words(type == EVENT_POKE ? num_words : 2 * num_words);
+                ok = fread(words.data(), sizeof(uint64_t), words.size(), file) == words.size();
+                if (!ok)
+                    break;
+
+                Bits actual = Bits::zeros(width);
+                for (size_t i = 0; i < num_words; i++)
+                    actual.set_word(i, words[i]);
+
+                if (type == EVENT_POKE) {
+                    sink << "  POKE " << names[id] << " <- " << actual << "\n";
+                } else {
+                    Bits expected = Bits::zeros(width);
+                    for (size_t i = 0; i < num_words; i++)
+                        expected.set_word(i, words[num_words + i]);
+                    sink << "EXPECT AT " << (unsigned long) cycle << "\t" << names[id] << " got " << actual
+                         << " expected " << expected << (type == EVENT_EXPECT_PASS ? " PASS\n" : " FAIL\n");
+                }
+                break;
+            }
+            default:
+                ok = false;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+#endif
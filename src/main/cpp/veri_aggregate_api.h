@@ -4,6 +4,12 @@
 #define __VERILATOR_AGGREGATE_API__
 
 #include "veri_api.h"
+
+// direct pointer to a wire inside a bundle, see VerilatorBundle::resolve.
+// Declared before including testbench.h, which uses it and includes this
+// header in turn
+typedef VerilatorDataWrapper *VerilatorHandle;
+
 #include "testbench.h"
 #include <vector>
 #include <map>
@@ -13,6 +19,14 @@
 static const char bundle_field_delim = '.';
 static const char idx_field_delim = '_';
 
+// type independent access to the elements of a VerilatorVec
+class VerilatorVecBase : public VerilatorDataWrapper {
+public:
+    virtual VerilatorDataWrapper &get_element(size_t idx) = 0;
+
+    virtual size_t get_num_elements() = 0;
+};
+
 class VerilatorBundle : public VerilatorDataWrapper {
 protected:
     std::map<std::string, VerilatorDataWrapper *> elements;
@@ -29,6 +43,12 @@ public:
         return *elements.at(name);
     }
 
+    // returns the wire at path, where fields of nested bundles are separated
+    // by '.' and vec elements are selected with a "_$idx" suffix, e.g.
+    // "req.bits.data_3". The handle stays valid for the lifetime of this
+    // bundle, so paths can be resolved once and reused on every cycle.
+    VerilatorHandle resolve(const std::string &path);
+
     Bits get_value() override {
         return first_wire->get_value();
     }
@@ -50,7 +70,7 @@ public:
 };
 
 template<class Data>
-class VerilatorVec : public VerilatorDataWrapper {
+class VerilatorVec : public VerilatorVecBase {
 private:
     std::vector<Data> elements;
 
@@ -63,6 +83,10 @@ public:
         return elements.at(idx);
     }
 
+    VerilatorDataWrapper &get_element(size_t idx) override {
+        return elements.at(idx);
+    }
+
     Bits get_value() override {
         return elements.at(0).get_value();
     }
@@ -79,7 +103,7 @@ public:
         return elements.at(0).get_name();
     }
 
-    size_t get_num_elements() {
+    size_t get_num_elements() override {
         return elements.size();
     }
 
@@ -94,6 +118,7 @@ public:
 template<class Module>
 std::map<std::string, Bits> Testbench<Module>::peek(VerilatorBundle &bundle) {
     std::map<std::string, Bits> values;
+    eval_if_needed();
     for (std::pair<std::string, VerilatorDataWrapper *> p : bundle.elements)
         values[p.first] = p.second->get_value();
     return values;
@@ -103,57 +128,41 @@ template<class Module>
 template<class Data>
 std::vector<Bits> Testbench<Module>::peek(VerilatorVec<Data> &vec) {
     std::vector<Bits> values;
+    eval_if_needed();
     for (Data &p : vec.elements)
         values.push_back(p.get_value());
     return values;
 }
 
+inline VerilatorHandle VerilatorBundle::resolve(const std::string &path) {
+    std::stringstream ss(path);
+    std::string key;
+    VerilatorDataWrapper *sub_bundle = this;
+    while (std::getline(ss, key, bundle_field_delim)) {
+        VerilatorBundle *bundle = static_cast<VerilatorBundle *>(sub_bundle);
+        size_t idx_delim_pos = key.rfind(idx_field_delim);
+        const std::string &idx_string = key.substr(idx_delim_pos + 1);
+        if (bundle->elements.find(key) == bundle->elements.end() && idx_delim_pos != std::string::npos &&
+            !idx_string.empty() && idx_string.find_first_not_of("0123456789") == std::string::npos) {
+            sub_bundle = &(*bundle)[key.substr(0, idx_delim_pos)];
+            sub_bundle = &static_cast<VerilatorVecBase *>(sub_bundle)->get_element(std::stoul(idx_string));
+        } else
+            sub_bundle = &(*bundle)[key];
+    }
+
+    return sub_bundle;
+}
+
 template<class Module>
 void Testbench<Module>::poke(VerilatorBundle &bundle, std::map<std::string, Bits> &values) {
-    for (const std::pair<const std::string, Bits> &p : values) {
-        std::stringstream ss(p.first);
-        std::string sub_key;
-        std::vector<std::string> sub_keys;
-        while (std::getline(ss, sub_key, bundle_field_delim))
-            sub_keys.push_back(sub_key);
-
-        VerilatorDataWrapper *sub_bundle = &bundle;
-        for (const std::string &key : sub_keys) {
-            size_t idx_delim_pos = key.rfind(idx_field_delim);
-            const std::string &idx_string = key.substr(idx_delim_pos + 1);
-            if (idx_delim_pos != std::string::npos && idx_string.find_first_not_of("0123456789") == std::string::npos) {
-                sub_bundle = &((*(VerilatorBundle *) sub_bundle)[key.substr(0, idx_delim_pos)]);
-                sub_bundle = &((*(VerilatorVec<VerilatorDataWrapper> *) sub_bundle)[std::stoi(idx_string)]);
-            } else
-                sub_bundle = &((*(VerilatorBundle *) sub_bundle)[key]);
-        }
-
-        poke(*sub_bundle, p.second);
-    }
+    for (const std::pair<const std::string, Bits> &p : values)
+        poke(*bundle.resolve(p.first), p.second);
 }
 
 template<class Module>
 void Testbench<Module>::expect(VerilatorBundle &bundle, std::map<std::string, Bits> &values) {
-    for (const std::pair<const std::string, Bits> &p : values) {
-        std::stringstream ss(p.first);
-        std::string sub_key;
-        std::vector<std::string> sub_keys;
-        while (std::getline(ss, sub_key, bundle_field_delim))
-            sub_keys.push_back(sub_key);
-
-        VerilatorDataWrapper *sub_bundle = &bundle;
-        for (const std::string &key : sub_keys) {
-            size_t idx_delim_pos = key.rfind(idx_field_delim);
-            const std::string &idx_string = key.substr(idx_delim_pos + 1);
-            if (idx_delim_pos != std::string::npos && idx_string.find_first_not_of("0123456789") == std::string::npos) {
-                sub_bundle = &((*(VerilatorBundle *) sub_bundle)[key.substr(0, idx_delim_pos)]);
-                sub_bundle = &((*(VerilatorVec<VerilatorDataWrapper> *) sub_bundle)[std::stoi(idx_string)]);
-            } else
-                sub_bundle = &((*(VerilatorBundle *) sub_bundle)[key]);
-        }
-
-        expect(*sub_bundle, p.second);
-    }
+    for (const std::pair<const std::string, Bits> &p : values)
+        expect(*bundle.resolve(p.first), p.second);
 }
 
 #endif
@@ -9,11 +9,22 @@
 #include <string>
 #include <iostream>
 #include "bits.h"
+#include "fixed_bits.h"
 
 class VerilatorDataWrapper {
 public:
     virtual Bits get_value() = 0;
 
+    // writes the value to the (get_width() + 63) / 64 words at words, zero
+    // above the width. The wrappers of verilator fields copy the field
+    // without building a Bits
+    virtual void get_words(uint64_t *words) {
+        Bits value = get_value();
+        size_t value_words = (value.get_width() + 63) / 64;
+        for (size_t i = 0; i < (get_width() + 63) / 64; i++)
+            words[i] = i < value_words ? value.get_word(i) : 0;
+    }
+
     virtual void put_value(Bits& bits) = 0;
 
     virtual size_t get_width() = 0;
@@ -34,6 +45,10 @@ public:
         return value;
     }
 
+    void get_words(uint64_t *words) override {
+        words[0] = *signal;
+    }
+
     void put_value(Bits& bits) override {
       uint64_t mask = 0xff;
       *signal = (CData)(mask & bits.get_word(0));
@@ -66,6 +81,10 @@ public:
         return value;
     }
 
+    void get_words(uint64_t *words) override {
+        words[0] = *signal;
+    }
+
     void put_value(Bits& bits) override {
       uint64_t mask = 0xffff;
       *signal = (SData)(mask & bits.get_word(0));
@@ -98,6 +117,10 @@ public:
         return value;
     }
 
+    void get_words(uint64_t *words) override {
+        words[0] = *signal;
+    }
+
     void put_value(Bits& bits) override {
       uint64_t mask = 0xffffffff;
       *signal = (IData)(mask & bits.get_word(0));
@@ -130,6 +153,10 @@ public:
         return value;
     }
 
+    void get_words(uint64_t *words) override {
+        words[0] = *signal;
+    }
+
     void put_value(Bits& bits) override {
       *signal = (QData)(bits.get_word(0));
     }
@@ -158,17 +185,17 @@ public:
 
     Bits get_value() override {
         Bits bits = Bits::zeros(get_width());
-        bool numWdatasEven = (numWdatas % 2) == 0;
-        for (size_t i = 0; i < numWdatas / 2; i++) {
-            uint64_t value = ((uint64_t) wdatas[i * 2 + 1]) << 32 | wdatas[i * 2];
-            bits.set_word(i, value);
-        }
-        if (!numWdatasEven) {
-            bits.set_word(numWdatas / 2, wdatas[numWdatas - 1]);
-        }
+        get_words(&bits.words()[0]);
         return bits;
     }
 
+    void get_words(uint64_t *words) override {
+        for (size_t i = 0; i < numWdatas / 2; i++)
+            words[i] = ((uint64_t) wdatas[i * 2 + 1]) << 32 | wdatas[i * 2];
+        if (numWdatas % 2 != 0)
+            words[numWdatas / 2] = wdatas[numWdatas - 1];
+    }
+
     void put_value(Bits& bits) override {
       bool numWdatasEven = (numWdatas % 2) == 0;
       for (int i = 0; i < numWdatas / 2; i++) {
@@ -197,4 +224,113 @@ private:
     size_t width;
 };
 
+// non-virtual accessor for ports of up to 64 bits, reads and writes the
+// verilator field of type T as a native integer masked to width W
+template<class T, size_t W>
+class VerilatorPort {
+    static_assert(W > 0 && W <= sizeof(T) * 8, "port width does not fit in field type");
+
+public:
+    typedef FixedBits<W> bits_type;
+
+    static const T mask = (T) ((~((uint64_t) 0)) >> (64 - W));
+
+    explicit VerilatorPort(T *_signal) : signal(_signal) {}
+
+    T get() const {
+      return *signal;
+    }
+
+    void set(T value) {
+      *signal = value & mask;
+    }
+
+    bits_type get_bits() const {
+      return bits_type(*signal);
+    }
+
+    void set_bits(const bits_type &bits) {
+      *signal = (T) bits.get_word(0);
+    }
+
+    // sets a uniformly random value
+    void randomize(Rng &rng) {
+      *signal = (T) rng.bits(W);
+    }
+
+    size_t get_width() const {
+      return W;
+    }
+
+private:
+    T *signal;
+};
+
+// non-virtual accessor for WData ports wider than 64 bits, values are moved
+// in and out of the verilator words as FixedBits<W>
+template<size_t W>
+class VerilatorWidePort {
+    static_assert(W > 64, "use VerilatorPort for ports of 64 bits or less");
+
+public:
+    typedef FixedBits<W> bits_type;
+
+    explicit VerilatorWidePort(WData *_wdatas) : wdatas(_wdatas) {}
+
+    bits_type get_bits() const {
+      return bits_type::from_words32(wdatas);
+    }
+
+    void set_bits(const bits_type &bits) {
+      bits.to_words32(wdatas);
+    }
+
+    // sets a uniformly random value, the bits of the top word above W stay
+    // zero
+    void randomize(Rng &rng) {
+      rng.fill_bytes(wdatas, ((W + 31) / 32) * 4);
+      if (W % 32 != 0)
+        wdatas[(W - 1) / 32] &= (~((WData) 0)) >> (32 - W % 32);
+    }
+
+    // returns the len bits starting at bit lo as a T, len must be at most 64
+    // and fit in T. Only the verilator words the field covers are read
+    template<class T = uint64_t>
+    T extract(size_t lo, size_t len) const {
+      assert(len <= sizeof(T) * 8 && lo + len <= W);
+      return (T) bits_extract_words(wdatas, lo, len);
+    }
+
+    template<class T = uint64_t>
+    T extract(const BitsField &field) const {
+      return extract<T>(field.lo, field.width);
+    }
+
+    // replaces the len bits starting at bit lo with the low bits of value,
+    // len must be at most 64. Only the verilator words the field covers are
+    // written
+    void insert(size_t lo, size_t len, uint64_t value) {
+      assert(lo + len <= W);
+      bits_insert_words(wdatas, lo, len, value);
+    }
+
+    void insert(const BitsField &field, uint64_t value) {
+      insert(field.lo, field.width, value);
+    }
+
+    // the verilator words covering the len bits starting at bit lo, which
+    // must be a multiple of 32
+    WordSpan<WData> words(size_t lo, size_t len) const {
+      assert(lo % 32 == 0 && len > 0 && lo + len <= W);
+      return WordSpan<WData>(wdatas + lo / 32, (len + 31) / 32);
+    }
+
+    size_t get_width() const {
+      return W;
+    }
+
+private:
+    WData *wdatas;
+};
+
 #endif
@@ -4,18 +4,22 @@ package vte
 
 import firrtl.ir._
 
+import scala.collection.immutable.ListMap
+
 object FirrtlToCppAST {
 
   def apply(c: Circuit): BundleCppAST = {
     getTopLevelCppAST((c.modules find (_.name == c.main)).get.ports)
   }
 
-  def portToCppAST(name: String, tpe: Type): CppASTNode = {
+  // flipped is true for data driven into the dut, i.e. an input port or a
+  // field under an odd number of flips of an output port
+  def portToCppAST(name: String, tpe: Type, flipped: Boolean = false): CppASTNode = {
     tpe match {
-      case b: BundleType => getBundleCppAST(name, b)
-      case v: VectorType => getVectorCppAST(name, v)
-      case u: UIntType   => getUIntCppAST(name, u.width)
-      case s: SIntType   => getUIntCppAST(name, s.width)
+      case b: BundleType => getBundleCppAST(name, b, flipped)
+      case v: VectorType => getVectorCppAST(name, v, flipped)
+      case u: UIntType   => getUIntCppAST(name, u.width, flipped)
+      case s: SIntType   => getUIntCppAST(name, s.width, flipped)
     }
   }
 
@@ -25,33 +29,35 @@ object FirrtlToCppAST {
     }
 
     dataPorts.head.tpe match {
-      case b: BundleType => getBundleCppAST("io", b)
+      case b: BundleType => getBundleCppAST("io", b, dataPorts.head.direction == Input)
     }
   }
 
-  def getBundleCppAST(name: String, bundleType: BundleType): BundleCppAST = {
-    val fields: Map[String, CppASTNode] = bundleType.fields.map({
-      field => field.name -> portToCppAST(s"${name}_${field.name}", field.tpe)
-    })(collection.breakOut)
+  def getBundleCppAST(name: String, bundleType: BundleType, flipped: Boolean = false): BundleCppAST = {
+    // keep the declaration order of the fields, it defines the port order of
+    // the generated testbench
+    val fields: Map[String, CppASTNode] = ListMap(bundleType.fields.map({
+      field => field.name -> portToCppAST(s"${name}_${field.name}", field.tpe, flipped ^ (field.flip == Flip))
+    }): _*)
 
     new BundleCppAST(name, fields)
   }
 
-  def getVectorCppAST(name: String, vectorType: VectorType): VecCppAST = {
+  def getVectorCppAST(name: String, vectorType: VectorType, flipped: Boolean = false): VecCppAST = {
     val children = (0 until vectorType.size) map {
-      i => portToCppAST(s"${name}_$i", vectorType.tpe)
+      i => portToCppAST(s"${name}_$i", vectorType.tpe, flipped)
     }
 
     new VecCppAST(name, children)
   }
 
-  def getUIntCppAST(name: String, width: Width): WireCppAST = {
+  def getUIntCppAST(name: String, width: Width, flipped: Boolean = false): WireCppAST = {
     val astWidth = width match {
       case i: IntWidth => i.width
       case UnknownWidth => sys.error("Unknown width")
     }
 
-    new WireCppAST(name, astWidth)
+    new WireCppAST(name, astWidth, flipped)
   }
 }
 
@@ -155,7 +161,7 @@ class VecCppAST(val instanceName: String,
   }
 }
 
-class WireCppAST(val instanceName: String, val width: BigInt) extends CppASTLeaf {
+class WireCppAST(val instanceName: String, val width: BigInt, val isInput: Boolean = false) extends CppASTLeaf {
 
   def sameTypeAs(other: CppASTNode): Boolean = {
     other match {
@@ -5,7 +5,31 @@ package vte
 import chisel3.HasChiselExecutionOptions
 import firrtl.{ComposableOptions, ExecutionOptionsManager, HasFirrtlOptions}
 
-case class TesterOptions(testbenchCppFile: String = "") extends ComposableOptions
+case class TesterOptions(
+                          testbenchCppFile: String = "",
+                          verilatorThreads: Int = 0,
+                          outputSplit: Int = -1,
+                          optimizationLevel: Int = 1,
+                          marchNative: Boolean = false,
+                          lto: Boolean = false,
+                          trace: Boolean = true,
+                          traceFst: Boolean = false,
+                          traceThreads: Int = 0,
+                          pgo: Boolean = false,
+                          savable: Boolean = false,
+                          buildCache: Boolean = true,
+                          objCache: String = "",
+                          build: Boolean = true,
+                          buildJobs: Int = 0
+                        ) extends ComposableOptions {
+
+  // sets the options belonging to a named group of build settings
+  def withBuildProfile(profile: String): TesterOptions = profile match {
+    case "debug" => copy(optimizationLevel = 1, marchNative = false, lto = false, trace = true)
+    case "fast"  => copy(optimizationLevel = 3, marchNative = true, lto = true, trace = false)
+    case other   => throw new IllegalArgumentException(s"unknown build profile $other, expected debug or fast")
+  }
+}
 
 trait HasTesterOptions {
   self: ExecutionOptionsManager =>
@@ -18,6 +42,67 @@ trait HasTesterOptions {
     .abbr("ttcf")
     .foreach { x => testerOptions = testerOptions.copy(testbenchCppFile = x) }
     .text("file containing implementation of testbench::run() method")
+
+  parser.opt[String]("build-profile")
+    .foreach { x => testerOptions = testerOptions.withBuildProfile(x) }
+    .text("debug (default: -O1 with tracing) or fast (-O3, -march=native, LTO, no tracing)")
+
+  parser.opt[Int]("verilator-threads")
+    .foreach { x => testerOptions = testerOptions.copy(verilatorThreads = x) }
+    .text("number of threads of the verilated model, 0 for a single threaded model")
+
+  parser.opt[Int]("output-split")
+    .foreach { x => testerOptions = testerOptions.copy(outputSplit = x) }
+    .text("split verilator output files and functions larger than this many statements, 0 to disable, -1 (default) to split only large designs")
+
+  parser.opt[Int]("optimization-level")
+    .foreach { x => testerOptions = testerOptions.copy(optimizationLevel = x) }
+    .text("optimization level (0-3) of verilator and of the C++ compiler")
+
+  parser.opt[Unit]("march-native")
+    .foreach { _ => testerOptions = testerOptions.copy(marchNative = true) }
+    .text("compile the model for the instruction set of the build machine")
+
+  parser.opt[Unit]("lto")
+    .foreach { _ => testerOptions = testerOptions.copy(lto = true) }
+    .text("compile and link with link time optimization")
+
+  parser.opt[Unit]("no-trace")
+    .foreach { _ => testerOptions = testerOptions.copy(trace = false) }
+    .text("do not compile waveform tracing into the model")
+
+  parser.opt[Unit]("trace-fst")
+    .foreach { _ => testerOptions = testerOptions.copy(traceFst = true) }
+    .text("write compressed FST waveforms instead of VCD")
+
+  parser.opt[Int]("trace-threads")
+    .foreach { x => testerOptions = testerOptions.copy(traceThreads = x) }
+    .text("number of threads writing the FST waveform in the background, 0 to write it in the simulation thread, " +
+      "ignored without --trace-fst")
+
+  parser.opt[Unit]("pgo")
+    .foreach { _ => testerOptions = testerOptions.copy(pgo = true) }
+    .text("build with profile guided optimization, using a run of the testbench as training run")
+
+  parser.opt[Unit]("savable")
+    .foreach { _ => testerOptions = testerOptions.copy(savable = true) }
+    .text("verilate the model with --savable so testbenches can checkpoint and restore it")
+
+  parser.opt[Unit]("no-build-cache")
+    .foreach { _ => testerOptions = testerOptions.copy(buildCache = false) }
+    .text("verilate the design even if it and the build options did not change since the last run")
+
+  parser.opt[String]("objcache")
+    .foreach { x => testerOptions = testerOptions.copy(objCache = x) }
+    .text("compiler cache such as ccache that make prefixes every compiler call with")
+
+  parser.opt[Unit]("no-build")
+    .foreach { _ => testerOptions = testerOptions.copy(build = false) }
+    .text("only verilate the design, leave compiling the generated makefile to the user")
+
+  parser.opt[Int]("build-jobs")
+    .foreach { x => testerOptions = testerOptions.copy(buildJobs = x) }
+    .text("number of parallel make jobs compiling the model, 0 (default) for one per processor")
 }
 
 class TesterOptionsManager
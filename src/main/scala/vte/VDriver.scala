@@ -2,6 +2,8 @@
 
 package vte
 
+import java.io.File
+
 import chisel3._
 import logger.Logger
 
@@ -28,14 +30,7 @@ object VDriver {
                           )(implicit tag: ClassTag[T]): Boolean = {
     optionsManagerVar.withValue(Some(optionsManager)) {
       Logger.makeScope(optionsManager) {
-        if (optionsManager.topName.isEmpty) {
-          if (optionsManager.targetDirName == ".") {
-            optionsManager.setTargetDirName("test_run_dir")
-          }
-          val genClassName = tag.runtimeClass.getName
-          val testerName = genClassName.split("""\$\$""").headOption.getOrElse("") + genClassName.hashCode.abs
-          optionsManager.setTargetDirName(s"${optionsManager.targetDirName}/$testerName")
-        }
+        setTargetDir(optionsManager, tag)
 
         val dut = setupVerilatorBackend(dutGenerator, optionsManager)
         true
@@ -43,6 +38,49 @@ object VDriver {
     }
   }
 
+  /**
+    * This verilates the device under test once, compiles the verilated model
+    * into a library and builds one executable per testbench file against it,
+    * compiling the testbench files in parallel
+    *
+    * @param dutGenerator          The device under test, a subclass of a Chisel3 module
+    * @param testbenchCppFileNames Files containing implementations of testbench::run()
+    * @param optionsManager        Use this to control options like which backend to use
+    * @return                      Returns the executables in the order of testbenchCppFileNames
+    */
+  def buildTestbenches[T <: Module](
+                                     dutGenerator: () => T,
+                                     testbenchCppFileNames: Seq[String],
+                                     optionsManager: TesterOptionsManager
+                                   )(implicit tag: ClassTag[T]): Seq[File] = {
+    optionsManagerVar.withValue(Some(optionsManager)) {
+      Logger.makeScope(optionsManager) {
+        setTargetDir(optionsManager, tag)
+
+        val testbenchCppFiles = testbenchCppFileNames.map(new File(_))
+        val dut = setupVerilatorBackend(dutGenerator, optionsManager, testbenchCppFiles)
+        val dir = new File(optionsManager.targetDirName)
+        testbenchCppFiles.map(setupVerilatorBackend.sharedTestbenchExecutable(dut.name, dir, _))
+      }
+    }
+  }
+
+  def buildTestbenches[T <: Module](dutGen: () => T, testbenchCppFileNames: Seq[String])
+                                   (implicit tag: ClassTag[T]): Seq[File] = {
+    buildTestbenches(dutGen, testbenchCppFileNames, new TesterOptionsManager)
+  }
+
+  private def setTargetDir(optionsManager: TesterOptionsManager, tag: ClassTag[_]): Unit = {
+    if (optionsManager.topName.isEmpty) {
+      if (optionsManager.targetDirName == ".") {
+        optionsManager.setTargetDirName("test_run_dir")
+      }
+      val genClassName = tag.runtimeClass.getName
+      val testerName = genClassName.split("""\$\$""").headOption.getOrElse("") + genClassName.hashCode.abs
+      optionsManager.setTargetDirName(s"${optionsManager.targetDirName}/$testerName")
+    }
+  }
+
   def apply[T <: Module](dutGen: () => T,
                                    testbenchCppFileName: String = "")(implicit tag: ClassTag[T]): Boolean = {
 
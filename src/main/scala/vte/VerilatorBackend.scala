@@ -3,8 +3,9 @@
 package vte
 
 import java.io._
-import java.nio.file.StandardCopyOption.REPLACE_EXISTING
-import java.nio.file.{FileAlreadyExistsException, Files, Paths}
+import java.nio.charset.StandardCharsets
+import java.nio.file.{Files, Paths}
+import java.security.MessageDigest
 
 import chisel3._
 import chisel3.core.BaseModule
@@ -12,6 +13,10 @@ import chisel3.internal.firrtl.Circuit
 import firrtl.annotations.CircuitName
 import firrtl.transforms._
 
+import scala.collection.mutable.ArrayBuffer
+import scala.concurrent.duration.Duration
+import scala.concurrent.{Await, Future}
+import scala.concurrent.ExecutionContext.Implicits.global
 import scala.sys.process.{ProcessBuilder, _}
 
 object getTopModule {
@@ -20,43 +25,116 @@ object getTopModule {
   }
 }
 
+/**
+  * Measures the wall clock time of the phases of a build, phases may run concurrently
+  */
+class PhaseTimer {
+  private val phases = ArrayBuffer[(String, Long)]()
+
+  def apply[T](phase: String)(body: => T): T = {
+    val start = System.nanoTime
+    try {
+      body
+    } finally {
+      val elapsed = System.nanoTime - start
+      synchronized { phases += phase -> elapsed }
+    }
+  }
+
+  def report(): Unit = synchronized {
+    phases foreach { case (phase, elapsed) =>
+      System.out.println(f"$phase%-32s ${elapsed / 1000000}%8d ms") // scalastyle:ignore regex
+    }
+  }
+}
+
+/**
+  * Writes content to file unless the file already holds exactly that content, so that the modification time of
+  * unchanged files stays the same and make does not rebuild what depends on them. Returns true if file was written
+  */
+object writeFileIfChanged {
+  def apply(file: File, content: Array[Byte]): Boolean = {
+    val path = file.toPath
+    if (Files.exists(path) && java.util.Arrays.equals(Files.readAllBytes(path), content)) {
+      false
+    } else {
+      Files.write(path, content)
+      true
+    }
+  }
+
+  def apply(file: File, content: String): Boolean = apply(file, content.getBytes(StandardCharsets.UTF_8))
+}
+
+/**
+  * Remembers a hash of everything verilator reads for a design, i.e. the Verilog, the generated and runtime C++
+  * files and the verilator command, so that an unchanged design is not verilated again
+  */
+object verilatorBuildCache {
+  val stampFileName = ".vte_build_hash"
+
+  def hash(files: Seq[File], strings: Seq[String]): String = {
+    val digest = MessageDigest.getInstance("SHA-256")
+    files foreach { file =>
+      digest.update(file.getAbsolutePath.getBytes(StandardCharsets.UTF_8))
+      if (file.exists()) digest.update(Files.readAllBytes(file.toPath))
+      digest.update(0.toByte)
+    }
+    strings foreach { string =>
+      digest.update(string.getBytes(StandardCharsets.UTF_8))
+      digest.update(0.toByte)
+    }
+    digest.digest().map("%02x".format(_)).mkString
+  }
+
+  // true if the last verilator run in dir was for inputs with this hash
+  def isUpToDate(dutFile: String, dir: File, hash: String): Boolean = {
+    val stamp = new File(dir, stampFileName)
+    stamp.exists() && new File(dir, s"V$dutFile.mk").exists() &&
+      new String(Files.readAllBytes(stamp.toPath), StandardCharsets.UTF_8) == hash
+  }
+
+  def record(dir: File, hash: String): Unit = writeFileIfChanged(new File(dir, stampFileName), hash)
+
+  def invalidate(dir: File): Unit = new File(dir, stampFileName).delete()
+}
+
 /**
   * Copies the necessary header files used for verilator compilation to the specified destination folder
   */
 object copyVerilatorHeaderFiles {
+  // runtime sources under vte/src/main/cpp used by every generated testbench
+  val runtimeFileNames: Seq[String] = Seq(
+    "bits.h",
+    "bits.cpp",
+    "capture.h",
+    "checkpoint.h",
+    "constrained_random.h",
+    "expect_batch.h",
+    "fixed_bits.h",
+    "flight_recorder.h",
+    "fork_runner.h",
+    "parallel_runner.h",
+    "port_layout.h",
+    "rng.h",
+    "scoreboard.h",
+    "stimulus.h",
+    "testbench.h",
+    "testbench_log.h",
+    "veri_aggregate_api.h",
+    "veri_api.h"
+  )
+
   def apply(destinationDirPath: String): Unit = {
     new File(destinationDirPath).mkdirs()
-    val bitsHFilePath = Paths.get(destinationDirPath + "/bits.h")
-    val bitsCppFilePath = Paths.get(destinationDirPath + "/bits.cpp")
-    val testbenchHFilePath = Paths.get(destinationDirPath + "/testbench.h")
-    val veriAggregateApiHFilePath = Paths.get(destinationDirPath + "/veri_aggregate_api.h")
-    val veriApiHFilePath = Paths.get(destinationDirPath + "/veri_api.h")
-    try {
-      Files.createFile(bitsHFilePath)
-      Files.createFile(bitsCppFilePath)
-      Files.createFile(testbenchHFilePath)
-      Files.createFile(veriAggregateApiHFilePath)
-      Files.createFile(veriApiHFilePath)
-    } catch {
-      case _: FileAlreadyExistsException =>
-        System.out.format("")
-      case x: IOException =>
-        System.err.format("createFile error: %s%n", x)
-    }
 
     val rootDirPath = new File(".").getAbsolutePath()
 
-    val bitsHFilePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp" + "/bits.h")
-    val bitsCppFilePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp" + "/bits.cpp")
-    val testbenchHFilePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp" + "/testbench.h")
-    val veriAggregateApiHFilePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp" + "/veri_aggregate_api.h")
-    val veriApiHFilePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp" + "/veri_api.h")
-
-    Files.copy(bitsHFilePathSrc, bitsHFilePath, REPLACE_EXISTING);
-    Files.copy(bitsCppFilePathSrc, bitsCppFilePath, REPLACE_EXISTING)
-    Files.copy(testbenchHFilePathSrc, testbenchHFilePath, REPLACE_EXISTING)
-    Files.copy(veriAggregateApiHFilePathSrc, veriAggregateApiHFilePath, REPLACE_EXISTING)
-    Files.copy(veriApiHFilePathSrc, veriApiHFilePath, REPLACE_EXISTING)
+    // unchanged files are not copied so that make does not rebuild the objects that include them
+    runtimeFileNames foreach { fileName =>
+      val filePathSrc = Paths.get(rootDirPath + "/vte/src/main/cpp/" + fileName)
+      writeFileIfChanged(new File(destinationDirPath, fileName), Files.readAllBytes(filePathSrc))
+    }
   }
 }
 
@@ -67,9 +145,74 @@ object setupVerilatorBackend {
                     dir: File,
                     vSources: Seq[File],
                     cppHarness: File,
-                    testbenchCppFile: File
+                    testbenchCppFile: File,
+                    testerOptions: TesterOptions = TesterOptions(),
+                    profileFlags: String = ""
                   ): ProcessBuilder = {
+    val command = verilatorCommand(dutFile, dir, vSources, cppHarness, Seq(testbenchCppFile), testerOptions, profileFlags)
+    System.out.println(s"${command.mkString(" ")}") // scalastyle:ignore regex
+    command
+  }
+
+  // arguments of the verilator run done by verilogToCpp, testbenchCppFiles are compiled and linked into the
+  // executable together with cppHarness
+  def verilatorCommand(
+                        dutFile: String,
+                        dir: File,
+                        vSources: Seq[File],
+                        cppHarness: File,
+                        testbenchCppFiles: Seq[File],
+                        testerOptions: TesterOptions = TesterOptions(),
+                        profileFlags: String = ""
+                      ): Seq[String] = {
     val topModule = dutFile
+    val optimizationFlag = s"-O${testerOptions.optimizationLevel}"
+
+    val traceFlags = if (!testerOptions.trace) {
+      Seq.empty[String]
+    } else {
+      // verilator only writes FST on separate threads, for VCD traceThreads is ignored
+      Seq(if (testerOptions.traceFst) "--trace-fst" else "--trace") ++
+        (if (testerOptions.traceFst && testerOptions.traceThreads > 0) {
+          Seq("--trace-threads", testerOptions.traceThreads.toString)
+        } else {
+          Seq.empty
+        })
+    }
+
+    val threadFlags = if (testerOptions.verilatorThreads > 0) {
+      Seq("--threads", testerOptions.verilatorThreads.toString)
+    } else {
+      Seq.empty[String]
+    }
+
+    val outputSplit = resolveOutputSplit(testerOptions, new File(dir, s"$dutFile.v"))
+    val outputSplitFlags = if (outputSplit > 0) {
+      Seq("--output-split", outputSplit.toString,
+        "--output-split-cfuncs", outputSplit.toString)
+    } else {
+      Seq.empty[String]
+    }
+
+    val savableFlags = if (testerOptions.savable) Seq("--savable") else Seq.empty[String]
+
+    val cppCompileFlags = Seq(optimizationFlag) ++
+      (if (testerOptions.marchNative) Seq("-march=native") else Seq.empty) ++
+      (if (testerOptions.lto) Seq("-flto") else Seq.empty) ++
+      (if (testerOptions.trace && testerOptions.traceFst) Seq("-DVM_TRACE_FST=1") else Seq.empty) ++
+      (if (testerOptions.savable) Seq("-DVTE_SAVABLE=1") else Seq.empty) ++
+      // run_forked refuses to fork threads it cannot copy
+      (if (testerOptions.verilatorThreads > 0) Seq(s"-DVTE_MODEL_THREADS=${testerOptions.verilatorThreads}") else Seq.empty) ++
+      (if (testerOptions.trace && testerOptions.traceFst && testerOptions.traceThreads > 0) {
+        Seq(s"-DVTE_TRACE_THREADS=${testerOptions.traceThreads}")
+      } else {
+        Seq.empty
+      }) ++
+      (if (profileFlags.nonEmpty) Seq(profileFlags) else Seq.empty)
+
+    val cppLinkFlags = Seq("-pthread") ++
+      (if (testerOptions.lto) Seq("-flto") else Seq.empty) ++
+      (if (profileFlags.nonEmpty) Seq(profileFlags) else Seq.empty)
 
     val blackBoxVerilogList = {
       val list_file = new File(dir, firrtl.transforms.BlackBoxSourceHelper.fileListName)
@@ -81,34 +224,180 @@ object setupVerilatorBackend {
       }
     }
 
-    val command = Seq(
-      "verilator",
-      testbenchCppFile.getAbsolutePath,
-      s"${dir.getAbsolutePath}/bits.cpp",
-      "--cc", s"${dir.getAbsolutePath}/$dutFile.v"
-    ) ++
+    val command = Seq("verilator") ++
+      testbenchCppFiles.map(_.getAbsolutePath) ++
+      Seq(
+        s"${dir.getAbsolutePath}/bits.cpp",
+        "--cc", s"${dir.getAbsolutePath}/$dutFile.v"
+      ) ++
       blackBoxVerilogList ++
       vSources.flatMap(file => Seq("-v", file.getAbsolutePath)) ++
       Seq("--assert",
         "-Wno-fatal",
         "-Wno-WIDTH",
-        "-Wno-STMTDLY",
-        "--trace",
-        "-O1",
+        "-Wno-STMTDLY") ++
+      traceFlags ++
+      threadFlags ++
+      outputSplitFlags ++
+      savableFlags ++
+      Seq(optimizationFlag,
         "--top-module", topModule,
         "+define+TOP_TYPE=V" + dutFile,
         s"+define+PRINTF_COND=!$topModule.reset",
         s"+define+STOP_COND=!$topModule.reset",
         "-CFLAGS",
-        s"""-std=c++11 -Wno-undefined-bool-conversion -pedantic -O1 -DTOP_TYPE=V$dutFile -DVL_USER_FINISH -include V$dutFile.h""",
+        s"""-std=c++11 -Wno-undefined-bool-conversion -pedantic ${cppCompileFlags.mkString(" ")} -DTOP_TYPE=V$dutFile -DVL_USER_FINISH -include V$dutFile.h""",
+        "-LDFLAGS", cppLinkFlags.mkString(" "),
         "--compiler", "clang",
         "-Mdir", dir.getAbsolutePath,
         "--exe", cppHarness.getAbsolutePath)
+    command
+  }
+
+  // verilog files larger than this are verilated with output splitting when the output split is automatic
+  val autoOutputSplitVerilogBytes: Long = 4L << 20
+  // statements per file and function when the output split is automatic
+  val autoOutputSplitStatements = 20000
+
+  // output split of the tester options, with -1 resolved from the size of verilogFile
+  def resolveOutputSplit(testerOptions: TesterOptions, verilogFile: File): Int = {
+    if (testerOptions.outputSplit >= 0) {
+      testerOptions.outputSplit
+    } else if (verilogFile.length > autoOutputSplitVerilogBytes) {
+      autoOutputSplitStatements
+    } else {
+      0
+    }
+  }
+
+  // parallel make jobs of the tester options, with 0 resolved to one per processor
+  def resolveBuildJobs(testerOptions: TesterOptions): Int = {
+    if (testerOptions.buildJobs > 0) testerOptions.buildJobs else Runtime.getRuntime.availableProcessors
+  }
+
+  // compiles and links the model and testbench with the makefile verilator
+  // generated in dir, the executable is V$dutFile in dir
+  // objCache, e.g. ccache, is prepended to every compiler call, target
+  // selects another target of the makefile such as V${dutFile}__ALL.a and
+  // makefile another makefile in dir such as the one of testbenchObjectsMakefile
+  def buildVerilatorModel(dutFile: String, dir: File, objCache: String = "", jobs: Int = 1,
+                          target: String = "", makefile: String = ""): ProcessBuilder = {
+    val objCacheFlags = if (objCache.nonEmpty) Seq(s"OBJCACHE=$objCache") else Seq.empty[String]
+    val makefileName = if (makefile.nonEmpty) makefile else s"V$dutFile.mk"
+    val command = Seq("make", s"-j$jobs", "-C", dir.getAbsolutePath, "-f", makefileName) ++ objCacheFlags ++
+      Seq(if (target.nonEmpty) target else s"V$dutFile")
     System.out.println(s"${command.mkString(" ")}") // scalastyle:ignore regex
     command
   }
 
-  def apply[T <: chisel3.Module](dutGen: () => T, optionsManager: TesterOptionsManager): T = {
+  // makefile on top of the one verilator generated whose testbench-objects target compiles the testbench, the main,
+  // bits.cpp and the verilator runtime without linking them, so that compile and link are timed separately
+  def testbenchObjectsMakefile(dutFile: String): String =
+    s"""# generated by vte, compiles the objects V$dutFile links
+       |include V$dutFile.mk
+       |
+       |testbench-objects: $$(VK_USER_OBJS) $$(VK_GLOBAL_OBJS)
+       |.PHONY: testbench-objects
+       |""".stripMargin
+
+  // removes the objects and archives of a previous build in dir so that the
+  // next build recompiles everything with its own flags
+  def cleanVerilatorBuild(dir: File): Unit = {
+    dir.listFiles.filter(f => f.getName.endsWith(".o") || f.getName.endsWith(".a")).foreach(_.delete())
+  }
+
+  // verilates and builds the testbench twice, first instrumented for
+  // profiling, then using the profile recorded by one run of the first build
+  def profileGuidedBuild(dutFile: String, dir: File, mainFile: File, testbenchCppFile: File,
+                         testerOptions: TesterOptions): Unit = {
+    val profileDir = new File(dir, "pgo")
+    val profileData = new File(dir, s"V$dutFile.profdata")
+    profileDir.mkdirs()
+    profileDir.listFiles.foreach(_.delete())
+    // the instrumented build leaves verilator output behind that a cached build must not reuse
+    verilatorBuildCache.invalidate(dir)
+
+    assert(verilogToCpp(dutFile, dir, vSources = Seq(), mainFile, testbenchCppFile, testerOptions,
+      s"-fprofile-generate=${profileDir.getAbsolutePath}").! == 0)
+    cleanVerilatorBuild(dir)
+    assert(buildVerilatorModel(dutFile, dir, testerOptions.objCache, resolveBuildJobs(testerOptions)).! == 0)
+
+    // training run, a failing testbench still produces a usable profile
+    Process(Seq(new File(dir, s"V$dutFile").getAbsolutePath), dir).!
+
+    val profiles = profileDir.listFiles.filter(_.getName.endsWith(".profraw")).map(_.getAbsolutePath)
+    assert(profiles.nonEmpty, "training run did not write a profile")
+    assert((Seq("llvm-profdata", "merge", s"-output=${profileData.getAbsolutePath}") ++ profiles).! == 0)
+
+    assert(verilogToCpp(dutFile, dir, vSources = Seq(), mainFile, testbenchCppFile, testerOptions,
+      s"-fprofile-use=${profileData.getAbsolutePath}").! == 0)
+    cleanVerilatorBuild(dir)
+    assert(buildVerilatorModel(dutFile, dir, testerOptions.objCache, resolveBuildJobs(testerOptions)).! == 0)
+  }
+
+  // name of the executable built from testbenchCppFile by sharedModelBuild
+  def sharedTestbenchExecutable(dutFile: String, dir: File, testbenchCppFile: File): File =
+    new File(dir, s"V${dutFile}_${testbenchCppFile.getName.stripSuffix(".cpp")}")
+
+  // makefile on top of the one verilator generated that archives the model, the verilator runtime, bits.cpp and the
+  // main into libV$dutFile.a and links every testbench against it
+  def sharedModelMakefile(dutFile: String, dir: File, testbenchCppFiles: Seq[File]): String = {
+    val library = s"libV$dutFile.a"
+    val executables = testbenchCppFiles.map(sharedTestbenchExecutable(dutFile, dir, _).getName)
+    val rules = testbenchCppFiles.zip(executables).map { case (file, executable) =>
+      s"""$executable.o: ${file.getAbsolutePath} ${dutFile}_testbench.h
+         |	$$(OBJCACHE) $$(CXX) $$(CXXFLAGS) $$(CPPFLAGS) $$(OPT_FAST) -c -o $$@ ${file.getAbsolutePath}
+         |
+         |$executable: $executable.o $library
+         |	$$(LINK) $$(LDFLAGS) $$^ $$(LOADLIBES) $$(LDLIBS) $$(LIBS) -o $$@
+         |""".stripMargin
+    }
+    s"""# generated by vte, builds the model once and links each testbench against it
+       |include V$dutFile.mk
+       |
+       |testbench-objects: ${executables.map(_ + ".o").mkString(" ")}
+       |testbenches: ${executables.mkString(" ")}
+       |.PHONY: testbench-objects testbenches
+       |
+       |$library: $$(VK_USER_OBJS) $$(VK_GLOBAL_OBJS) V${dutFile}__ALL.a
+       |	cp V${dutFile}__ALL.a $$@
+       |	$$(AR) rs $$@ $$(VK_USER_OBJS) $$(VK_GLOBAL_OBJS)
+       |
+       |""".stripMargin + rules.mkString("\n")
+  }
+
+  // compiles the verilated model together with the runtime and the main into one library and compiles and links
+  // each of testbenchCppFiles against it in parallel, so the model is compiled once for any number of testbenches.
+  // The model must have been verilated without a testbench file, see apply
+  def sharedModelBuild(dutFile: String, dir: File, testbenchCppFiles: Seq[File], testerOptions: TesterOptions,
+                       timer: PhaseTimer = new PhaseTimer): Unit = {
+    val names = testbenchCppFiles.map(sharedTestbenchExecutable(dutFile, dir, _).getName)
+    assert(names.distinct.size == names.size, "testbench files linked against one model need distinct names")
+
+    val makefile = new File(dir, s"V${dutFile}_shared.mk")
+    writeFileIfChanged(makefile, sharedModelMakefile(dutFile, dir, testbenchCppFiles))
+
+    val jobs = resolveBuildJobs(testerOptions)
+    val objCacheFlags = if (testerOptions.objCache.nonEmpty) Seq(s"OBJCACHE=${testerOptions.objCache}") else Seq.empty
+    def make(target: String): Unit = {
+      val command = Seq("make", s"-j$jobs", "-C", dir.getAbsolutePath, "-f", makefile.getName) ++
+        objCacheFlags ++ Seq(target)
+      System.out.println(s"${command.mkString(" ")}") // scalastyle:ignore regex
+      assert(command.! == 0)
+    }
+
+    timer("model library compile") { make(s"libV$dutFile.a") }
+    timer("testbench compile") { make("testbench-objects") }
+    timer("testbench link") { make("testbenches") }
+  }
+
+  def apply[T <: chisel3.Module](dutGen: () => T, optionsManager: TesterOptionsManager): T =
+    apply(dutGen, optionsManager, Seq.empty)
+
+  // with sharedTestbenchCppFiles, verilates the design without a testbench and builds one executable per file
+  // with sharedModelBuild instead of verilating it with the testbench of the tester options
+  def apply[T <: chisel3.Module](dutGen: () => T, optionsManager: TesterOptionsManager,
+                                 sharedTestbenchCppFiles: Seq[File]): T = {
     import firrtl.{ChirrtlForm, CircuitState}
 
     optionsManager.makeTargetDir()
@@ -132,61 +421,120 @@ object setupVerilatorBackend {
           List(BlackBoxTargetDirAnno(optionsManager.targetDirName))
 
         //val transforms = optionsManager.firrtlOptions.customTransforms
-        copyVerilatorHeaderFiles(optionsManager.targetDirName)
-        FirrtlToCppAST(chirrtl)
+        val testerOptions = optionsManager.testerOptions
+        val timer = new PhaseTimer
 
-        // Generate Verilog
+        // Generate Verilog, concurrently with the C++ files below
         val verilogFile = new File(dir, s"${circuit.name}.v")
-        val verilogWriter = new FileWriter(verilogFile)
-
-        val compileResult = (new firrtl.VerilogCompiler).compileAndEmit(
-          CircuitState(chirrtl, ChirrtlForm, annotations)
-        )
-        val compiledStuff = compileResult.getEmittedCircuit
-        verilogWriter.write(compiledStuff.value)
-        verilogWriter.close()
+        val verilogDone = Future {
+          timer("FIRRTL compile") {
+            val compileResult = (new firrtl.VerilogCompiler).compileAndEmit(
+              CircuitState(chirrtl, ChirrtlForm, annotations)
+            )
+            val compiledStuff = compileResult.getEmittedCircuit
+            writeFileIfChanged(verilogFile, compiledStuff.value)
+          }
+        }
 
-        val codeGen = new VerilatorTestbenchGenerator(chirrtl)
+        val sharedModel = sharedTestbenchCppFiles.nonEmpty
 
-        // Generate Testbench header
         val testbenchHeaderFileName = s"${circuit.name}_testbench.h"
         val testbenchHeaderFile = new File(dir, testbenchHeaderFileName)
-        val testbenchHeaderWriter = new FileWriter(testbenchHeaderFile)
-        val testbenchHeaderCode = codeGen.testbenchHeaderGen()
-        testbenchHeaderWriter.append(testbenchHeaderCode)
-        testbenchHeaderWriter.close()
-
-        // Generate empty testbench::run() file unless one already exists
-        val testbenchCppFileName = if (optionsManager.testerOptions.testbenchCppFile.isEmpty) {
+        val testbenchCppFileName = if (testerOptions.testbenchCppFile.isEmpty) {
           s"${dir.getAbsolutePath}/${circuit.name}_testbench.cpp"
         } else {
-          optionsManager.testerOptions.testbenchCppFile
+          testerOptions.testbenchCppFile
         }
         val testbenchCppFile = new File(testbenchCppFileName)
-        if (!Files.exists(Paths.get(testbenchCppFileName))) {
-          val testbenchCppWriter = new FileWriter(testbenchCppFile)
-          val testbenchCppCode = codeGen.testbenchCppGen()
-          testbenchCppWriter.append(testbenchCppCode)
-          testbenchCppWriter.close()
-        }
-
-        // Generate Main
         val mainFileName = s"${circuit.name}_main.cpp"
         val mainFile = new File(dir, mainFileName)
-        val mainWriter = new FileWriter(mainFile)
-        val mainStuff = codeGen.mainGen()
-        mainWriter.append(mainStuff)
-        mainWriter.close()
 
-        assert(
-          verilogToCpp(
+        timer("C++ header generation") {
+          copyVerilatorHeaderFiles(optionsManager.targetDirName)
+          FirrtlToCppAST(chirrtl)
+
+          val codeGen = new VerilatorTestbenchGenerator(chirrtl)
+
+          // Generate Testbench header
+          writeFileIfChanged(testbenchHeaderFile, codeGen.testbenchHeaderGen())
+
+          // Generate empty testbench::run() file unless one already exists
+          if (!sharedModel && !Files.exists(Paths.get(testbenchCppFileName))) {
+            val testbenchCppWriter = new FileWriter(testbenchCppFile)
+            val testbenchCppCode = codeGen.testbenchCppGen()
+            testbenchCppWriter.append(testbenchCppCode)
+            testbenchCppWriter.close()
+          }
+
+          // Generate Main
+          writeFileIfChanged(mainFile, codeGen.mainGen())
+        }
+
+        Await.result(verilogDone, Duration.Inf)
+
+        // verilates unless the last run in dir had the same inputs, the testbench .cpp files of the user are left to
+        // make, which only recompiles them if they changed
+        def verilateIfChanged(testbenchCppFiles: Seq[File]): Unit = {
+          val verilatorArgs = verilatorCommand(
             circuit.name,
             dir,
             vSources = Seq(),
             mainFile,
-            testbenchCppFile
-          ).! == 0
-        )
+            testbenchCppFiles,
+            testerOptions
+          )
+
+          val blackBoxListFile = new File(dir, firrtl.transforms.BlackBoxSourceHelper.fileListName)
+          val blackBoxFiles = if (blackBoxListFile.exists()) {
+            new String(Files.readAllBytes(blackBoxListFile.toPath), StandardCharsets.UTF_8)
+              .split("\n").map(_.trim).filter(_.nonEmpty).map(new File(_)).toSeq
+          } else {
+            Seq.empty[File]
+          }
+          val inputFiles = Seq(verilogFile, testbenchHeaderFile, mainFile, blackBoxListFile) ++ blackBoxFiles ++
+            copyVerilatorHeaderFiles.runtimeFileNames.map(new File(dir, _))
+          val inputHash = verilatorBuildCache.hash(inputFiles, verilatorArgs :+ chirrtl.serialize)
+
+          if (testerOptions.buildCache && verilatorBuildCache.isUpToDate(circuit.name, dir, inputHash)) {
+            System.out.println(s"${circuit.name} is unchanged, reusing the verilator output in ${dir.getAbsolutePath}") // scalastyle:ignore regex
+          } else {
+            verilatorBuildCache.invalidate(dir)
+            System.out.println(s"${verilatorArgs.mkString(" ")}") // scalastyle:ignore regex
+            timer("verilator") { assert(verilatorArgs.! == 0) }
+            verilatorBuildCache.record(dir, inputHash)
+          }
+        }
+
+        if (sharedModel) {
+          verilateIfChanged(Seq.empty)
+          sharedModelBuild(circuit.name, dir, sharedTestbenchCppFiles, testerOptions, timer)
+        } else if (testerOptions.pgo) {
+          timer("profile guided build") {
+            profileGuidedBuild(circuit.name, dir, mainFile, testbenchCppFile, testerOptions)
+          }
+        } else {
+          verilateIfChanged(Seq(testbenchCppFile))
+
+          // the model is built first so that its many objects get all make jobs to themselves
+          if (testerOptions.build) {
+            val jobs = resolveBuildJobs(testerOptions)
+            timer("model compile") {
+              assert(buildVerilatorModel(circuit.name, dir, testerOptions.objCache, jobs,
+                s"V${circuit.name}__ALL.a").! == 0)
+            }
+            val objectsMakefile = s"V${circuit.name}_objects.mk"
+            writeFileIfChanged(new File(dir, objectsMakefile), testbenchObjectsMakefile(circuit.name))
+            timer("testbench compile") {
+              assert(buildVerilatorModel(circuit.name, dir, testerOptions.objCache, jobs,
+                "testbench-objects", objectsMakefile).! == 0)
+            }
+            timer("testbench link") {
+              assert(buildVerilatorModel(circuit.name, dir, testerOptions.objCache, jobs).! == 0)
+            }
+          }
+        }
+
+        timer.report()
 
         dut
     }
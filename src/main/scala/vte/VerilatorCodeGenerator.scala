@@ -28,25 +28,41 @@ class VerilatorTestbenchGenerator(val circuit: Circuit) {
     }(collection.breakOut)
   }
 
+  private def getVerilatorDataType(wire: WireCppAST): String = {
+    if (wire.width <= 8) {
+      "CData"
+    } else if (wire.width <= 16) {
+      "SData"
+    } else if (wire.width <= 32) {
+      "IData"
+    } else if (wire.width <= 64) {
+      "QData"
+    } else {
+      "WData"
+    }
+  }
+
   private def getVerilatorClassName(data: CppASTNode): String = {
     data match {
-      case w: WireCppAST =>
-          if (w.width <= 8) {
-            "VerilatorCData"
-          } else if (w.width <= 16) {
-            "VerilatorSData"
-          } else if (w.width <= 32) {
-            "VerilatorIData"
-          } else if (w.width <= 64) {
-            "VerilatorQData"
-          } else {
-            "VerilatorWData"
-          }
+      case w: WireCppAST => s"Verilator${getVerilatorDataType(w)}"
       case b: BundleCppAST => s"VerilatorBundle${bundleTypeIndexMap(b)}"
       case v: VecCppAST => s"VerilatorVec<${getVerilatorClassName(v.children.head)}>"
     }
   }
 
+  private def getPortClassName(wire: WireCppAST): String = {
+    if (wire.width <= 64) {
+      s"VerilatorPort<${getVerilatorDataType(wire)}, ${wire.width}>"
+    } else {
+      s"VerilatorWidePort<${wire.width}>"
+    }
+  }
+
+  // pointer to the verilator field of wire, wide ports are WData arrays
+  private def getDutFieldPointer(wire: WireCppAST): String = {
+    if (wire.width <= 64) s"&dut->${wire.instanceName}" else s"dut->${wire.instanceName}"
+  }
+
   private def makeVerilatorInstantiation(instanceName: String, data: CppASTNode): String = {
     val args = data match {
       case w: WireCppAST => Seq(w.instanceName)
@@ -120,6 +136,100 @@ class VerilatorTestbenchGenerator(val circuit: Circuit) {
     codeBuffer.append("};\n\n")
   }
 
+  def makePortsStruct(codeBuffer: StringBuilder) {
+    val portsName = s"${dutName}_ports"
+    val dutVerilatorClassName = "V" + dutName
+
+    codeBuffer.append(s"struct $portsName {\n")
+    cppAST.wires foreach { wire =>
+      codeBuffer.append(s"    ${getPortClassName(wire)} ${wire.instanceName};\n")
+    }
+    codeBuffer.append("\n")
+
+    if (cppAST.wires.isEmpty) {
+      codeBuffer.append(s"    explicit $portsName($dutVerilatorClassName *dut) {}\n")
+    } else {
+      cppAST.wires map {
+        wire => s"${wire.instanceName}(${getDutFieldPointer(wire)})"
+      } addString(codeBuffer,
+        start = s"    explicit $portsName($dutVerilatorClassName *dut) :\n            ",
+        sep = ",\n            ",
+        end = " {}\n")
+    }
+    codeBuffer.append("};\n\n")
+  }
+
+  // wires under node with their path relative to the enclosing bundle, the
+  // position of their lowest bit and their width when node is packed like
+  // Chisel's asUInt, i.e. the first field of a bundle and the last element of
+  // a vec are in the highest bits. Returns the fields in declaration order
+  // and the packed width
+  private def packedFields(node: CppASTNode, path: String, lo: BigInt): (Seq[(String, BigInt, BigInt)], BigInt) = {
+    // packs children from the lowest bits up, returns the fields of every
+    // child and their total width
+    def pack(children: Seq[(String, CppASTNode)]): (Seq[Seq[(String, BigInt, BigInt)]], BigInt) = {
+      children.foldLeft((Seq.empty[Seq[(String, BigInt, BigInt)]], BigInt(0))) {
+        case ((blocks, width), (name, child)) =>
+          val (childFields, childWidth) = packedFields(child, name, lo + width)
+          (blocks :+ childFields, width + childWidth)
+      }
+    }
+
+    node match {
+      case w: WireCppAST => (Seq((path, lo, w.width)), w.width)
+      case b: BundleCppAST =>
+        val prefix = if (path.isEmpty) "" else s"$path."
+        val (blocks, width) = pack(b.fields.toSeq.reverse map { case (name, child) => (prefix + name, child) })
+        (blocks.reverse.flatten, width)
+      case v: VecCppAST =>
+        val (blocks, width) = pack(v.children.zipWithIndex map { case (child, i) => (s"${path}_$i", child) })
+        (blocks.flatten, width)
+    }
+  }
+
+  // emits a struct with one static method per bundle of the dut returning the
+  // BitsLayout of the bundle packed like Chisel's asUInt, named after the
+  // bundle instance since bundles of one class may differ in widths
+  def makeLayoutsStruct(codeBuffer: StringBuilder) {
+    codeBuffer.append(s"struct ${dutName}_layouts {\n")
+    cppAST foreachPreOrderDepthFirst {
+      case b: BundleCppAST =>
+        val (fields, width) = packedFields(b, "", 0)
+        codeBuffer.append(s"    static BitsLayout ${b.instanceName}() {\n")
+        fields map {
+          case (name, lo, fieldWidth) => s"""{"$name", $lo, $fieldWidth}"""
+        } addString(codeBuffer,
+          start = "        static const BitsField fields[] = {\n            ",
+          sep = ",\n            ",
+          end = "\n        };\n")
+        codeBuffer.append(s"        return BitsLayout(fields, ${fields.size}, $width);\n")
+        codeBuffer.append("    }\n\n")
+      case _ => Unit
+    }
+    codeBuffer.append("};\n\n")
+  }
+
+  // emits an override of Testbench::$methodName listing wires in order
+  def makePortListMethod(codeBuffer: StringBuilder, methodName: String, wires: Seq[WireCppAST]) {
+    codeBuffer.append(s"    void $methodName(std::vector<PortDescriptor> &port_list) override {\n")
+    wires foreach { wire =>
+      codeBuffer.append(
+        s"""        port_list.push_back(PortDescriptor("${wire.instanceName}", ${wire.width}, ${getDutFieldPointer(wire)}));\n""")
+    }
+    codeBuffer.append("    }\n\n")
+  }
+
+  // emits the override of Testbench::random_input_fields, one field per input
+  // wire whose default range is given by the width of the wire
+  def makeRandomFieldsMethod(codeBuffer: StringBuilder, wires: Seq[WireCppAST]) {
+    codeBuffer.append("    void random_input_fields(ConstrainedRandom &random) override {\n")
+    wires foreach { wire =>
+      codeBuffer.append(
+        s"""        random.add(PortDescriptor("${wire.instanceName}", ${wire.width}, ${getDutFieldPointer(wire)}));\n""")
+    }
+    codeBuffer.append("    }\n\n")
+  }
+
   def testbenchHeaderGen(): String = {
     val codeBuffer = new StringBuilder
     val dutVerilatorClassName = "V" + dutName
@@ -144,24 +254,38 @@ class VerilatorTestbenchGenerator(val circuit: Circuit) {
       case _ => Unit
     }
 
+    makePortsStruct(codeBuffer)
+    makeLayoutsStruct(codeBuffer)
+
     codeBuffer.append(s"class $testbenchName : public Testbench<$dutVerilatorClassName> {\n")
 
     val ioName = "io"
+    val portsName = "ports"
 
     // public members
     codeBuffer.append("public:\n")
     codeBuffer.append(s"    ${getVerilatorClassName(cppAST)} $ioName;\n")
+    codeBuffer.append(s"    ${dutName}_ports $portsName;\n\n")
 
     // constructor
     val constructorStart = s"""    $testbenchName(): $ioName("""
     cppAST.wires map {
-      data => s"""${getVerilatorClassName(data)}("${data.instanceName}", ${data.width}, &dut->${data.instanceName})"""
+      data => s"""${getVerilatorClassName(data)}("${data.instanceName}", ${data.width}, ${getDutFieldPointer(data)})"""
     } addString (codeBuffer,
       start=constructorStart,
       sep=s",\n${" " * constructorStart.length}",
-      end=") {\n")
+      end=s"),\n${" " * (constructorStart.length - ioName.length - 1)}$portsName(dut) {\n")
     codeBuffer.append("    }\n\n")
 
+    val inputWires = cppAST.wires filter (_.isInput)
+    inputWires map (wire => s"${wire.instanceName}:${wire.width}") addString(codeBuffer,
+      start = "    // stimulus csv header: ",
+      sep = ",",
+      end = "\n")
+    makePortListMethod(codeBuffer, "input_ports", inputWires)
+    makePortListMethod(codeBuffer, "output_ports", cppAST.wires filterNot (_.isInput))
+    makeRandomFieldsMethod(codeBuffer, inputWires)
+
     codeBuffer.append("    void run();\n")
     codeBuffer.append("};\n\n")
     codeBuffer.append("#endif")
@@ -186,16 +310,20 @@ class VerilatorTestbenchGenerator(val circuit: Circuit) {
     codeBuffer.append(s"""#include "$testbenchName.h"\n\n""")
 
     codeBuffer.append("double sc_time_stamp() {\n")
-    codeBuffer.append(s"    return $testbenchName::main_time;\n")
+    codeBuffer.append(s"    return $testbenchName::time_stamp();\n")
     codeBuffer.append("}\n\n")
 
     codeBuffer.append("int main(int argc, char **argv) {\n")
     codeBuffer.append(s"    $testbenchName tb;\n")
 
     codeBuffer.append("#if VM_TRACE\n")
+    codeBuffer.append("#if VM_TRACE_FST\n")
+    codeBuffer.append(s"""    std::string vcdfile = "$testbenchName.fst";\n""")
+    codeBuffer.append("#else\n")
     codeBuffer.append(s"""    std::string vcdfile = "$testbenchName.vcd";\n""")
+    codeBuffer.append("#endif\n")
     codeBuffer.append("    Verilated::traceEverOn(true);\n")
-    codeBuffer.append("    VerilatedVcdC* tfp = new VerilatedVcdC;\n")
+    codeBuffer.append("    VerilatedTraceFile* tfp = new VerilatedTraceFile;\n")
     codeBuffer.append("    tb.dut->trace(tfp, 99);\n")
     codeBuffer.append("    tfp->open(vcdfile.c_str());\n")
     codeBuffer.append("    tb.init_dump(tfp);\n")
@@ -0,0 +1,28 @@
+// small design for the benchmarks and tests in this directory. io_out_bits
+// adds io_in_bits in every cycle io_in_valid is high, io_out_valid follows
+// io_in_valid one cycle later
+module Counter(
+  input         clock,
+  input         reset,
+  input         io_in_valid,
+  input  [15:0] io_in_bits,
+  output        io_out_valid,
+  output [63:0] io_out_bits
+);
+  reg [63:0] count;
+  reg        valid;
+
+  always @(posedge clock) begin
+    if (reset) begin
+      count <= 64'h0;
+      valid <= 1'b0;
+    end else begin
+      if (io_in_valid)
+        count <= count + {48'h0, io_in_bits};
+      valid <= io_in_valid;
+    end
+  end
+
+  assign io_out_bits = count;
+  assign io_out_valid = valid;
+endmodule
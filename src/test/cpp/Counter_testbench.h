@@ -0,0 +1,57 @@
+// hand written counterpart of the testbench header vte generates for
+// Counter.v, used by the benchmarks and tests in this directory
+
+#ifndef Counter_testbench_H
+#define Counter_testbench_H
+
+#include "VCounter.h"
+#include "veri_api.h"
+#include "veri_aggregate_api.h"
+#include "testbench.h"
+
+struct Counter_ports {
+    VerilatorPort<CData, 1> io_in_valid;
+    VerilatorPort<SData, 16> io_in_bits;
+    VerilatorPort<CData, 1> io_out_valid;
+    VerilatorPort<QData, 64> io_out_bits;
+
+    explicit Counter_ports(VCounter *dut) :
+            io_in_valid(&dut->io_in_valid),
+            io_in_bits(&dut->io_in_bits),
+            io_out_valid(&dut->io_out_valid),
+            io_out_bits(&dut->io_out_bits) {}
+};
+
+class Counter_testbench : public Testbench<VCounter> {
+public:
+    VerilatorCData io_in_valid;
+    VerilatorSData io_in_bits;
+    VerilatorCData io_out_valid;
+    VerilatorQData io_out_bits;
+    Counter_ports ports;
+
+    Counter_testbench() : io_in_valid("io_in_valid", 1, &dut->io_in_valid),
+                          io_in_bits("io_in_bits", 16, &dut->io_in_bits),
+                          io_out_valid("io_out_valid", 1, &dut->io_out_valid),
+                          io_out_bits("io_out_bits", 64, &dut->io_out_bits),
+                          ports(dut) {}
+
+    void random_input_fields(ConstrainedRandom &random) override {
+        random.add(PortDescriptor("io_in_valid", 1, &dut->io_in_valid));
+        random.add(PortDescriptor("io_in_bits", 16, &dut->io_in_bits));
+    }
+
+    void input_ports(std::vector<PortDescriptor> &port_list) override {
+        port_list.push_back(PortDescriptor("io_in_valid", 1, &dut->io_in_valid));
+        port_list.push_back(PortDescriptor("io_in_bits", 16, &dut->io_in_bits));
+    }
+
+    void output_ports(std::vector<PortDescriptor> &port_list) override {
+        port_list.push_back(PortDescriptor("io_out_valid", 1, &dut->io_out_valid));
+        port_list.push_back(PortDescriptor("io_out_bits", 64, &dut->io_out_bits));
+    }
+
+    void run();
+};
+
+#endif
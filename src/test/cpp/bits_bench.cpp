@@ -0,0 +1,151 @@
+// times the peek and expect round trip of Bits with inline storage against
+// the heap allocated std::vector storage Bits used before, and counts the
+// allocations per round trip of each. The inline side goes through the
+// shipped VerilatorIData and VerilatorWData wrappers, the heap side repeats
+// the steps of their get_value() on a copy of the old storage
+//
+// build: make bench, see Makefile
+// usage: bits_bench [iterations]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include "veri_api.h"
+
+static unsigned long num_allocations = 0;
+
+void *operator new(size_t size) {
+    num_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// the storage of Bits before inline words, every value allocates its words
+struct HeapBits {
+    size_t width;
+    std::vector<uint64_t> data;
+
+    explicit HeapBits(uint64_t value) : width(64) {
+        data.push_back(value);
+    }
+
+    HeapBits(size_t _width, bool dont_care) : width(_width), data((_width + 63) / 64, 0) {}
+
+    void set_width(size_t _width) {
+        width = _width;
+    }
+
+    void set_word(size_t i, uint64_t word) {
+        data[i] = word;
+    }
+
+    bool operator==(const HeapBits &other) const {
+        return width == other.width && data == other.data;
+    }
+};
+
+struct BenchResult {
+    double ns_per_op;
+    double allocations_per_op;
+};
+
+// body(i) is one round trip, returns the number of expects that passed so
+// the loop cannot be optimized away
+template<class Body>
+static BenchResult run_bench(unsigned long iterations, Body body) {
+    unsigned long passed = 0;
+    unsigned long allocations_before = num_allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+        passed += body(i);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    if (passed != iterations)
+        std::cerr << "unexpected result " << passed << std::endl;
+
+    BenchResult result;
+    result.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    result.allocations_per_op = (double) (num_allocations - allocations_before) / iterations;
+    return result;
+}
+
+static void print_result(const char *name, const BenchResult &result) {
+    std::cout << name << "\t" << result.ns_per_op << " ns\t" << result.allocations_per_op << " allocations"
+              << std::endl;
+}
+
+// VerilatorIData::get_value before inline words
+static HeapBits heap_get_idata(IData *signal, size_t width) {
+    HeapBits value(*signal);
+    value.set_width(width);
+    return value;
+}
+
+// VerilatorWData::get_value before inline words
+static HeapBits heap_get_wdata(WData *words, size_t width) {
+    size_t num_words = (width + 31) / 32;
+    HeapBits value(width, false);
+    for (size_t i = 0; i < num_words / 2; i++)
+        value.set_word(i, ((uint64_t) words[i * 2 + 1]) << 32 | words[i * 2]);
+    if (num_words % 2)
+        value.set_word(num_words / 2, words[num_words - 1]);
+    return value;
+}
+
+int main(int argc, char **argv) {
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    // a peek of a 17 bit port followed by an expect against a literal, the
+    // same steps as Testbench::expect
+    IData narrow_field = 0;
+    VerilatorIData narrow("io_narrow", 17, &narrow_field);
+    print_result("heap 17 bit", run_bench(iterations, [&](unsigned long i) {
+        narrow_field = (IData) (i & 0x1ffff);
+        HeapBits actual = heap_get_idata(&narrow_field, 17);
+        HeapBits expected(i & 0x1ffff);
+        expected.set_width(17);
+        return actual == expected ? 1 : 0;
+    }));
+    print_result("inline 17 bit", run_bench(iterations, [&](unsigned long i) {
+        narrow_field = (IData) (i & 0x1ffff);
+        Bits actual = narrow.get_value();
+        Bits expected(i & 0x1ffff);
+        expected.set_width(17);
+        return actual == expected ? 1 : 0;
+    }));
+
+    // a 100 bit port, two words, still inline
+    WData wide_field[4] = {0, 0, 0, 0};
+    VerilatorWData wide("io_wide", 100, wide_field);
+    print_result("heap 100 bit", run_bench(iterations, [&](unsigned long i) {
+        wide_field[0] = (WData) i;
+        wide_field[2] = (WData) (i & 0xf);
+        HeapBits actual = heap_get_wdata(wide_field, 100);
+        HeapBits expected(100, false);
+        expected.set_word(0, i & 0xffffffff);
+        expected.set_word(1, i & 0xf);
+        return actual == expected ? 1 : 0;
+    }));
+    print_result("inline 100 bit", run_bench(iterations, [&](unsigned long i) {
+        wide_field[0] = (WData) i;
+        wide_field[2] = (WData) (i & 0xf);
+        Bits actual = wide.get_value();
+        Bits expected = Bits::zeros(100);
+        expected.set_word(0, i & 0xffffffff);
+        expected.set_word(1, i & 0xf);
+        return actual == expected ? 1 : 0;
+    }));
+    return 0;
+}
@@ -0,0 +1,119 @@
+// tests of Bits that need no verilated model
+//
+// build: make test, see Makefile
+
+#include <iostream>
+
+#include "bits.h"
+
+static int num_errors = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        num_errors++;
+    }
+}
+
+static size_t width_of(const Bits &bits) {
+    return bits.get_width();
+}
+
+static void test_operators() {
+    Bits a = Bits::zeros(100);
+    Bits b = Bits::zeros(70);
+    a.set_word(0, 0xf0f0f0f0f0f0f0f0ULL);
+    a.set_word(1, 0xabcdeULL);
+    b.set_word(0, 0xff00ff00ff00ff00ULL);
+    b.set_word(1, 0x3fULL);
+
+    // the operators return Bits, so the accessors work on their results
+    check((a >> 3).get_width() == 100, "a shift keeps the width");
+    check((a >> 4).get_word(0) == 0xef0f0f0f0f0f0f0fULL, "a right shift moves bits down across words");
+    check((a << 4).get_word(1) == 0xabcdefULL, "a left shift moves bits up across words");
+    check((a & b).get_word(0) == 0xf000f000f000f000ULL, "& of the low words");
+    check((a & b).get_word(1) == 0x1eULL, "& of the high words");
+    check((a | b).get_width() == 100, "| has the width of the wider operand");
+    check((a ^ b).get_word(0) == 0x0ff00ff00ff00ff0ULL, "^ of the low words");
+    check((~b).get_word(1) == 0x0ULL && (~b).get_width() == 70, "~ keeps the width and clears unused bits");
+    check(width_of(a & b) == 100, "a result binds to const Bits &");
+
+    // a result kept in a variable owns its words
+    auto kept = a & b;
+    a.set_word(0, 0);
+    check(kept.get_word(0) == 0xf000f000f000f000ULL, "a kept result does not refer to its operands");
+
+    // an rvalue left operand narrower than right is not updated in place
+    Bits narrow = Bits::zeros(8);
+    narrow.set_word(0, 0x81);
+    Bits widened = (narrow << 0) | b;
+    check(widened.get_width() == 70, "an rvalue narrower than right widens");
+    check(widened.get_word(0) == 0xff00ff00ff00ff81ULL, "an rvalue narrower than right keeps right's bits");
+
+    Bits chained = ((a & ~b) | (b << 3)) ^ (a >> 1);
+    Bits expected = a;
+    expected &= ~b;
+    expected |= b << 3;
+    expected ^= a >> 1;
+    check(chained == expected, "a chain equals the compound operators");
+}
+
+// slices include both ends, the width was high - low before
+static void test_slice() {
+    Bits a = Bits::zeros(100);
+    a.set_word(0, 0x8000000000000001ULL);
+    a.set_word(1, 0x5ULL);
+
+    check(a(7, 0).get_width() == 8, "a(7, 0) is 8 bits wide");
+    check(a(7, 0).get_word(0) == 0x1ULL, "a(7, 0) keeps bit 0");
+    check(a(0, 0).get_width() == 1 && a(0, 0).get_word(0) == 1, "a(i, i) is bit i");
+    check(a(63, 63).get_word(0) == 1, "a(63, 63) is the top bit of word 0");
+    check(a(99, 0).get_width() == 100, "a(width - 1, 0) is as wide as a");
+    check(a(99, 0) == a, "a(width - 1, 0) equals a");
+
+    Bits across = a(66, 63);
+    check(across.get_width() == 4, "a slice across words is high - low + 1 wide");
+    check(across.get_word(0) == 0xbULL, "a slice across words reads both words");
+}
+
+static void test_compare() {
+    Bits minus_one = Bits::zeros(8);
+    minus_one.set_word(0, 0xff);
+    Bits one = Bits::zeros(100);
+    one.set_word(0, 1);
+    Bits empty;
+
+    check(one < minus_one && minus_one > one, "unsigned comparisons zero extend");
+    check(minus_one.slt(one) && one.sgt(minus_one), "signed comparisons sign extend");
+    check(!(empty < Bits::zeros(64)) && empty <= Bits::zeros(64), "width 0 compares equal to zero");
+    check(empty < one && empty.slt(one), "width 0 is less than one");
+    check(minus_one.slt(empty) && empty.sgt(minus_one), "width 0 is not negative");
+    check(empty.sle(empty) && empty.sge(empty) && !empty.slt(empty), "width 0 equals itself");
+}
+
+static void test_sext() {
+    Bits minus_two = Bits::zeros(4);
+    minus_two.set_word(0, 0xe);
+    Bits extended = minus_two.sext(100);
+    check(extended.get_width() == 100, "sext sets the width");
+    check(extended.get_word(0) == 0xfffffffffffffffeULL && extended.get_word(1) == 0xfffffffffULL,
+          "sext copies the sign bit up to the width");
+    check(minus_two.zext(100).get_word(0) == 0xe && minus_two.zext(100).get_word(1) == 0, "zext fills zeros");
+
+    Bits empty;
+    Bits empty_extended = empty.sext(70);
+    check(empty_extended.get_width() == 70, "sext of width 0 sets the width");
+    check(empty_extended.get_word(0) == 0 && empty_extended.get_word(1) == 0, "sext of width 0 is zero");
+}
+
+int main() {
+    test_operators();
+    test_slice();
+    test_compare();
+    test_sext();
+
+    if (num_errors)
+        return 1;
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,82 @@
+// tests of ExpectBatch on wrapped fields, no verilated model needed
+//
+// build: make test, see Makefile
+
+#include <iostream>
+
+#include "expect_batch.h"
+
+static int num_errors = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        num_errors++;
+    }
+}
+
+// a wrapper without its own get_words, like the aggregates
+class ValueWrapper : public VerilatorDataWrapper {
+public:
+    explicit ValueWrapper(const Bits &_value) : value(_value) {}
+
+    Bits get_value() override { return value; }
+
+    void put_value(Bits &bits) override { value = bits; }
+
+    size_t get_width() override { return value.get_width(); }
+
+    std::string get_name() override { return "value"; }
+
+    Bits value;
+};
+
+int main() {
+    CData narrow_field = 0x5;
+    QData quad_field = 0x123456789abcdefULL;
+    WData wide_field[3] = {0x11111111, 0x22222222, 0x3};
+    VerilatorCData narrow("narrow", 4, &narrow_field);
+    VerilatorQData quad("quad", 64, &quad_field);
+    VerilatorWData wide("wide", 66, wide_field);
+    Bits wide_value = Bits::zeros(80);
+    wide_value.set_word(1, 0xabcd);
+    ValueWrapper other(wide_value);
+
+    Bits wide_expected = Bits::zeros(66);
+    wide_expected.set_word(0, 0x2222222211111111ULL);
+    wide_expected.set_word(1, 0x3);
+
+    // expected values and masks may be temporaries
+    ExpectBatch batch;
+    batch.add(narrow, Bits(0x5), NULL);
+    batch.add(quad, Bits(0x123456789abcdefULL), NULL);
+    batch.add(wide, wide_expected, NULL);
+    batch.add(other, wide_value, NULL);
+    batch.sample();
+    check(!batch.any_mismatch(), "matching values pass");
+    check(batch.get_actual(2) == wide_expected, "wide values are read word by word");
+    check(batch.get_actual(3) == wide_value, "wrappers without get_words are read through get_value");
+
+    wide_field[2] = 0x1;
+    narrow_field = 0x4;
+    batch.sample();
+    check(batch.any_mismatch(), "a changed field fails");
+    check(batch.mismatch(0) && !batch.mismatch(1) && batch.mismatch(2) && !batch.mismatch(3),
+          "only the changed checks fail");
+
+    // the mask ignores bit 0 of narrow and bit 65 of wide
+    Bits narrow_mask(0xe);
+    Bits wide_mask = Bits::zeros(66);
+    wide_mask.set_word(0, ~(uint64_t) 0);
+    wide_mask.set_word(1, 0x1);
+    batch.clear();
+    batch.add(narrow, Bits(0x5), &narrow_mask);
+    batch.add(wide, wide_expected, &wide_mask);
+    batch.sample();
+    check(!batch.any_mismatch(), "masked bits are ignored");
+
+    if (num_errors)
+        return 1;
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+// forks children from a testbench with a scoreboard attached, every child
+// samples more transactions than the ring holds, so without a checker thread
+// of its own a child would wait for the ring forever
+//
+// build: make test, see Makefile
+
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+#include "Counter_testbench.h"
+#include "fork_runner.h"
+
+void Counter_testbench::run() {}
+
+double sc_time_stamp() {
+    return Counter_testbench::time_stamp();
+}
+
+static int num_errors = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        num_errors++;
+    }
+}
+
+int main() {
+    // a hang fails the test instead of stalling the build
+    alarm(60);
+
+    Counter_testbench tb;
+    tb.set_log_level(LOG_SILENT);
+    tb.reset(5);
+
+    // reference model of io_out_bits, the children change the increment
+    QData increment = 1;
+    QData expected = 0;
+    Scoreboard<QData> scoreboard(
+            [&tb](unsigned long, QData &txn) {
+                if (!tb.ports.io_out_valid.get())
+                    return false;
+                txn = tb.ports.io_out_bits.get();
+                return true;
+            },
+            [&increment, &expected](unsigned long, const QData &txn, std::string &message) {
+                expected += increment;
+                if (txn == expected)
+                    return true;
+                message = "io_out_bits " + std::to_string(txn) + " != " + std::to_string(expected);
+                return false;
+            },
+            8);
+    tb.attach_scoreboard(scoreboard);
+
+    tb.poke(tb.ports.io_in_valid, 1);
+    tb.poke(tb.ports.io_in_bits, 1);
+    tb.step(20);
+    unsigned long fork_cycle = tb.m_tickcount;
+
+    // child 2 pokes an increment the reference model does not expect
+    std::vector<ForkRunResult> results;
+    bool passed = run_forked<Counter_testbench>(tb, 3, 0, 1, results,
+            [&increment](Counter_testbench &child, size_t i) {
+                increment = i + 1;
+                child.poke(child.ports.io_in_bits, i == 2 ? 4 : i + 1);
+                child.run_cycles(100);
+                child.step(100);
+            });
+
+    check(!passed, "run_forked reports the failing child");
+    check(results.size() == 3, "one result per child");
+    for (size_t i = 0; i < results.size(); i++)
+        check(results[i].reported, "every child reports");
+    check(!results[0].failed && !results[1].failed, "children 0 and 1 pass");
+    check(results[2].failed, "child 2 fails");
+    check(results[2].first_failed_cycle == fork_cycle + 1, "child 2 fails in its first cycle");
+    check(results[0].cycles == fork_cycle + 200, "child 0 runs every cycle");
+
+    // the parent keeps checking with its own checker thread
+    tb.step(20);
+    check(tb.drain_scoreboards(), "the parent still passes");
+    check(scoreboard.get_num_sampled() == 40, "the parent samples its own cycles");
+    tb.finish();
+
+    if (num_errors) {
+        print_fork_summary(results, std::cout);
+        return 1;
+    }
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,64 @@
+// run_forked on a testbench built for a multithreaded model starts no child,
+// fork() would only copy the thread calling it
+//
+// build: make test, see Makefile
+
+#define VTE_MODEL_THREADS 2
+
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+
+#include "Counter_testbench.h"
+#include "fork_runner.h"
+
+void Counter_testbench::run() {}
+
+double sc_time_stamp() {
+    return Counter_testbench::time_stamp();
+}
+
+static int num_errors = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        num_errors++;
+    }
+}
+
+int main() {
+    Counter_testbench tb;
+    tb.set_log_level(LOG_SILENT);
+    tb.reset(5);
+
+    check(!tb.single_threaded(), "the testbench knows the model is multithreaded");
+
+    size_t num_ran = 0;
+    std::vector<ForkRunResult> results;
+    bool passed = run_forked<Counter_testbench>(tb, 2, 0, 1, results,
+            [&num_ran](Counter_testbench &child, size_t) {
+                num_ran++;
+                child.step(10);
+            });
+
+    check(!passed, "run_forked fails");
+    check(num_ran == 0, "no child runs its body");
+    check(results.size() == 2, "one result per child");
+    for (size_t i = 0; i < results.size(); i++) {
+        check(results[i].failed && !results[i].reported, "every child fails without report");
+        check(results[i].fork_errno == ENOTSUP, "every child has ENOTSUP");
+    }
+
+    std::ostringstream summary;
+    print_fork_summary(results, summary);
+    check(summary.str().find("CHILD 1 NOT STARTED") != std::string::npos, "the summary names children not started");
+    tb.finish();
+
+    if (num_errors) {
+        std::cout << summary.str();
+        return 1;
+    }
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+// times Testbench::run_cycles against step(1) in a loop, one step(n) and a
+// hand written verilator main loop on Counter.v, at LOG_SILENT with nothing
+// traced or captured
+//
+// build: make bench, see Makefile
+// usage: run_cycles_bench [cycles]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "Counter_testbench.h"
+
+void Counter_testbench::run() {}
+
+double sc_time_stamp() {
+    return Counter_testbench::time_stamp();
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_result(const char *name, unsigned long cycles, double seconds, double baseline_seconds) {
+    std::cout << name << "\t" << (unsigned long) (cycles / seconds) << " cycles/s\t"
+              << seconds / baseline_seconds << "x hand written" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long cycles = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    Counter_testbench tb;
+    tb.set_log_level(LOG_SILENT);
+    tb.reset(5);
+    tb.poke(tb.ports.io_in_valid, 1);
+    tb.poke(tb.ports.io_in_bits, 1);
+
+    // the loop of a hand written verilator main
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    vluint64_t time = tb.main_time;
+    for (unsigned long i = 0; i < cycles; i++) {
+        tb.dut->clock = 0;
+        tb.dut->eval();
+        time++;
+        tb.dut->clock = 1;
+        tb.dut->eval();
+        time++;
+    }
+    tb.main_time = time;
+    double hand_written = seconds_since(start);
+    print_result("hand written", cycles, hand_written, hand_written);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < cycles; i++)
+        tb.step(1);
+    print_result("step(1)", cycles, seconds_since(start), hand_written);
+
+    start = std::chrono::steady_clock::now();
+    tb.step((int) cycles);
+    print_result("step(n)", cycles, seconds_since(start), hand_written);
+
+    start = std::chrono::steady_clock::now();
+    tb.run_cycles(cycles);
+    print_result("run_cycles", cycles, seconds_since(start), hand_written);
+
+    // a stop condition that reads a port every cycle and never fires
+    start = std::chrono::steady_clock::now();
+    Counter_testbench *bench = &tb;
+    tb.run_cycles(cycles, [bench]() { return bench->ports.io_out_bits.get() == ~(QData) 0; });
+    print_result("run_cycles stop", cycles, seconds_since(start), hand_written);
+
+    tb.finish();
+    return 0;
+}